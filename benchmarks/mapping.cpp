@@ -0,0 +1,1042 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * Throughput benchmarks of the mapping hot paths on synthetic scans.
+ *
+ * Benchmark arguments encode the scan type (0 lidar, 1 depth camera, 2 indoor, 3 dense lidar),
+ * the map resolution in centimeters and further variant switches. Besides the timings, every
+ * benchmark reports point and voxel rates as well as the peak resident set size during the
+ * benchmark.
+ *
+ */
+//----------------------------------------------------------------------
+
+#include "scan_generators.h"
+
+#include <benchmark/benchmark.h>
+#include <vdb_mapping/QuantizedOccupancyVDBMapping.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <string>
+#include <tbb/global_control.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/*!
+ * \brief Number of heap allocations of the process, counted by the replaced operator new
+ */
+std::atomic<std::size_t> allocation_count(0);
+
+/*!
+ * \brief Flag stating whether the peak resident set size was reset for the running benchmark
+ */
+bool peak_rss_reset = false;
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+  ++allocation_count;
+  if (void* ptr = std::malloc(size == 0 ? 1 : size))
+  {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace vdb_mapping {
+namespace benchmarks {
+
+/*!
+ * \brief Occupancy mapping which integrates updates voxel by voxel through an accessor and the
+ * virtual update functions, as it was done before the update rules were supplied as compile-time
+ * policy and applied to whole leaves
+ */
+class VirtualOccupancyVDBMapping : public OccupancyVDBMapping
+{
+public:
+  using OccupancyVDBMapping::OccupancyVDBMapping;
+
+  UpdateGridT::Ptr updateMap(const UpdateGridT::Ptr& temp_grid) override
+  {
+    UpdateGridT::Ptr change          = UpdateGridT::create(false);
+    UpdateGridT::Accessor change_acc = change->getAccessor();
+    if (temp_grid->empty())
+    {
+      return change;
+    }
+
+    bool state_changed  = false;
+    GridT::Accessor acc = getGrid()->getAccessor();
+    // Probability update lambda for free space grid elements
+    auto miss = [&](float& voxel_value, bool& active) {
+      const bool last_state = active;
+      updateFreeNode(voxel_value, active);
+      state_changed = last_state != active;
+    };
+    // Probability update lambda for occupied grid elements
+    auto hit = [&](float& voxel_value, bool& active) {
+      const bool last_state = active;
+      updateOccupiedNode(voxel_value, active);
+      state_changed = last_state != active;
+    };
+
+    for (UpdateGridT::ValueOnCIter iter = temp_grid->cbeginValueOn(); iter; ++iter)
+    {
+      state_changed = false;
+      if (*iter)
+      {
+        acc.modifyValueAndActiveState(iter.getCoord(), hit);
+      }
+      else
+      {
+        acc.modifyValueAndActiveState(iter.getCoord(), miss);
+      }
+      if (state_changed)
+      {
+        change_acc.setValueOn(iter.getCoord(), true);
+      }
+    }
+    return change;
+  }
+};
+
+Config benchmarkConfig(const bool parallel = false)
+{
+  Config conf;
+  conf.max_range            = 20;
+  conf.prob_hit             = 0.7;
+  conf.prob_miss            = 0.4;
+  conf.prob_thres_max       = 0.51;
+  conf.prob_thres_min       = 0.49;
+  conf.static_env           = false;
+  conf.parallel_raycasting  = parallel;
+  conf.parallel_integration = parallel;
+  return conf;
+}
+
+PointCloudT::Ptr generateScan(const int scan_type, const Eigen::Vector3d& origin)
+{
+  switch (scan_type)
+  {
+    case 1:
+      return depthCameraScan(origin);
+    case 2:
+      return indoorScan(origin);
+    case 3:
+      // About one million points, as produced by a high resolution lidar
+      return spinningLidarScan(origin, 256, 4096);
+    default:
+      return spinningLidarScan(origin);
+  }
+}
+
+/*!
+ * \brief Builds a map by inserting sparse lidar scans along a straight trajectory
+ *
+ * \param map Map which is filled
+ * \param extent Length of the trajectory in meters
+ */
+void buildMap(OccupancyVDBMapping& map, const double extent)
+{
+  for (double x = -0.5 * extent; x <= 0.5 * extent; x += 10.0)
+  {
+    const Eigen::Vector3d origin(x, 0, 0);
+    map.insertPointCloud(spinningLidarScan(origin, 32, 1024), origin);
+  }
+}
+
+std::string temporaryDirectory()
+{
+  char directory_template[] = "/tmp/vdb_mapping_benchmarkXXXXXX";
+  const char* directory     = mkdtemp(directory_template);
+  return directory ? std::string(directory) + "/" : std::string("/tmp/");
+}
+
+/*!
+ * \brief Resets the peak resident set size of the process to its current resident set size
+ *
+ * Has to be called at the start of every benchmark, so the peak reported by setRateCounters
+ * only covers this benchmark.
+ */
+void resetPeakResidentSetSize()
+{
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  peak_rss_reset = static_cast<bool>(clear_refs);
+}
+
+/*!
+ * \brief Peak resident set size of the process since the last reset in megabytes
+ */
+double peakResidentSetSizeMB()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmHWM:") == 0)
+    {
+      // The peak is reported in kilobytes
+      return std::strtod(line.c_str() + 6, nullptr) / 1024.0;
+    }
+  }
+  return 0.0;
+}
+
+void setRateCounters(benchmark::State& state, const double points, const double voxels)
+{
+  if (points > 0)
+  {
+    state.counters["points/s"] =
+      benchmark::Counter(points, benchmark::Counter::kIsIterationInvariantRate);
+  }
+  if (voxels > 0)
+  {
+    state.counters["voxels/s"] =
+      benchmark::Counter(voxels, benchmark::Counter::kIsIterationInvariantRate);
+  }
+  // Without a reset, the peak would cover all benchmarks which ran before in this process
+  if (peak_rss_reset)
+  {
+    state.counters["peak_rss_MB"] = peakResidentSetSizeMB();
+    peak_rss_reset                = false;
+  }
+}
+
+/*!
+ * \brief Current resident set size of the process in megabytes
+ */
+double residentSetSizeMB()
+{
+  std::ifstream statm("/proc/self/statm");
+  std::size_t total_pages    = 0;
+  std::size_t resident_pages = 0;
+  statm >> total_pages >> resident_pages;
+  return static_cast<double>(resident_pages) * static_cast<double>(sysconf(_SC_PAGESIZE)) /
+         (1024.0 * 1024.0);
+}
+
+/*!
+ * \brief Full insertion of a scan. Arguments: scan type, resolution [cm], parallel modes
+ */
+void BM_InsertPointCloud(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(1)) / 100.0);
+  map.setConfig(benchmarkConfig(state.range(2) != 0));
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr cloud = generateScan(static_cast<int>(state.range(0)), origin);
+
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid;
+  OccupancyVDBMapping::UpdateGridT::Ptr overwrite_grid;
+  for (auto _ : state)
+  {
+    map.insertPointCloud(cloud, origin, update_grid, overwrite_grid);
+  }
+  setRateCounters(state,
+                  static_cast<double>(cloud->size()),
+                  static_cast<double>(update_grid->activeVoxelCount()));
+}
+BENCHMARK(BM_InsertPointCloud)
+  ->ArgsProduct({{0, 1, 2}, {5, 10, 20}, {0, 1}})
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Insertion of one cycle of a robot with 6 lidars and 4 depth cameras. Arguments:
+ * resolution [cm], mode (0 one insertion per sensor, 1 sequential accumulation, 2 parallel batch)
+ */
+void BM_InsertMultiSensor(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig());
+  std::vector<OccupancyVDBMapping::SensorMeasurement> measurements;
+  std::size_t num_points = 0;
+  for (int sensor = 0; sensor < 10; ++sensor)
+  {
+    const double angle = 2.0 * M_PI * sensor / 10;
+    const Eigen::Vector3d origin(0.5 * std::cos(angle), 0.5 * std::sin(angle), 0.5);
+    PointCloudT::Ptr cloud =
+      sensor < 6 ? spinningLidarScan(origin, 32, 1024) : depthCameraScan(origin, 320, 240);
+    num_points += cloud->size();
+    measurements.push_back({cloud, origin, 0.0});
+  }
+
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid;
+  OccupancyVDBMapping::UpdateGridT::Ptr overwrite_grid;
+  for (auto _ : state)
+  {
+    switch (state.range(1))
+    {
+      case 0:
+        for (const auto& measurement : measurements)
+        {
+          map.insertPointCloud(measurement.cloud, measurement.origin, update_grid, overwrite_grid);
+        }
+        break;
+      case 1:
+        for (const auto& measurement : measurements)
+        {
+          map.accumulateUpdate(measurement.cloud, measurement.origin, measurement.max_range);
+        }
+        map.integrateUpdate(update_grid, overwrite_grid);
+        map.resetUpdate();
+        break;
+      default:
+        map.insertPointClouds(measurements, update_grid, overwrite_grid);
+        break;
+    }
+  }
+  setRateCounters(state,
+                  static_cast<double>(num_points),
+                  static_cast<double>(update_grid->activeVoxelCount()));
+}
+BENCHMARK(BM_InsertMultiSensor)
+  ->ArgsProduct({{5, 10, 20}, {0, 1, 2}})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+/*!
+ * \brief Long running insertion of lidar scans along a closed loop. Reports the heap allocations
+ * per scan and the growth of the resident set size over the second half of the run. Arguments:
+ * number of scans (72000 correspond to one hour at 20 Hz), grid recycling (0 the caller holds the
+ * update and change grids of the last two scans, which prevents their reuse)
+ *
+ * The hour long run is opt-in, see longRunArguments.
+ */
+void BM_LongRunInsertion(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(0.1);
+  map.setConfig(benchmarkConfig());
+  // Scans are generated up front, so that only the allocations of the mapping are counted
+  std::vector<std::pair<Eigen::Vector3d, PointCloudT::Ptr> > scans;
+  for (int i = 0; i < 200; ++i)
+  {
+    const double angle = 2.0 * M_PI * i / 200;
+    const Eigen::Vector3d origin(20.0 * std::cos(angle), 20.0 * std::sin(angle), 0);
+    scans.emplace_back(origin, spinningLidarScan(origin, 16, 1024));
+  }
+  const std::size_t num_scans = static_cast<std::size_t>(state.range(0));
+  const bool recycle          = state.range(1) != 0;
+
+  std::size_t half_allocations = 0;
+  std::size_t end_allocations  = 0;
+  double half_rss              = 0.0;
+  for (auto _ : state)
+  {
+    OccupancyVDBMapping::UpdateGridT::Ptr update_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr overwrite_grid;
+    std::deque<OccupancyVDBMapping::UpdateGridT::Ptr> held_grids;
+    for (std::size_t i = 0; i < num_scans; ++i)
+    {
+      if (i == num_scans / 2)
+      {
+        half_allocations = allocation_count;
+        half_rss         = residentSetSizeMB();
+      }
+      const auto& scan = scans[i % scans.size()];
+      map.insertPointCloud(scan.second, scan.first, update_grid, overwrite_grid);
+      if (!recycle)
+      {
+        held_grids.push_back(update_grid);
+        held_grids.push_back(overwrite_grid);
+        while (held_grids.size() > 4)
+        {
+          held_grids.pop_front();
+        }
+      }
+    }
+    end_allocations = allocation_count;
+  }
+  const double rss = residentSetSizeMB();
+  setRateCounters(state, static_cast<double>(num_scans * scans.front().second->size()), 0);
+  state.counters["allocs/scan"] = static_cast<double>(end_allocations - half_allocations) /
+                                  static_cast<double>(num_scans - num_scans / 2);
+  state.counters["rss_MB"]        = rss;
+  state.counters["rss_growth_MB"] = rss - half_rss;
+}
+
+/*!
+ * \brief Registers the arguments of BM_LongRunInsertion, adding the hour long run only if the
+ * environment variable VDB_MAPPING_LONG_BENCHMARKS is set
+ */
+void longRunArguments(benchmark::internal::Benchmark* benchmark)
+{
+  benchmark->Args({1200, 0});
+  benchmark->Args({1200, 1});
+  if (std::getenv("VDB_MAPPING_LONG_BENCHMARKS") != nullptr)
+  {
+    benchmark->Args({72000, 1});
+  }
+}
+BENCHMARK(BM_LongRunInsertion)->Apply(longRunArguments)->Iterations(1)->Unit(benchmark::kSecond);
+
+/*!
+ * \brief Raycasting of a scan into a fresh update grid. Arguments: scan type, resolution [cm],
+ * parallel raycasting, endpoint deduplication, maximum number of threads (0 TBB default)
+ *
+ * Runs with a thread limit measure the scaling of the parallel raycasting in wall clock time.
+ */
+void BM_RaycastPointCloud(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  std::unique_ptr<tbb::global_control> thread_limit;
+  if (state.range(4) > 0)
+  {
+    thread_limit.reset(new tbb::global_control(tbb::global_control::max_allowed_parallelism,
+                                               static_cast<std::size_t>(state.range(4))));
+  }
+  OccupancyVDBMapping map(static_cast<double>(state.range(1)) / 100.0);
+  Config conf                = benchmarkConfig(state.range(2) != 0);
+  conf.deduplicate_endpoints = state.range(3) != 0;
+  map.setConfig(conf);
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr cloud = generateScan(static_cast<int>(state.range(0)), origin);
+
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid;
+  for (auto _ : state)
+  {
+    update_grid = OccupancyVDBMapping::UpdateGridT::create(false);
+    OccupancyVDBMapping::UpdateGridT::Accessor acc = update_grid->getAccessor();
+    map.raycastPointCloud(cloud, origin, acc);
+  }
+  setRateCounters(state,
+                  static_cast<double>(cloud->size()),
+                  static_cast<double>(update_grid->activeVoxelCount()));
+}
+BENCHMARK(BM_RaycastPointCloud)
+  ->ArgsProduct({{0, 1, 2}, {5, 10, 20}, {0, 1}, {0, 1}, {0}})
+  ->ArgsProduct({{0, 3}, {10}, {1}, {0, 1}, {1, 2, 4, 8, 16}})
+  ->UseRealTime()
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Raycasting of a lidar scan with intensities into a reused update grid. Arguments: input
+ * (0 copy into an xyz cloud, 1 intensity cloud, 2 raw buffer with five floats per point)
+ *
+ * The allocs/scan counter reports the heap allocations per scan.
+ */
+void BM_RaycastPointLayout(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(0.1);
+  map.setConfig(benchmarkConfig());
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr scan = spinningLidarScan(origin);
+  pcl::PointCloud<pcl::PointXYZI> intensity_cloud;
+  std::vector<float> buffer;
+  for (const pcl::PointXYZ& pt : *scan)
+  {
+    pcl::PointXYZI point;
+    point.x         = pt.x;
+    point.y         = pt.y;
+    point.z         = pt.z;
+    point.intensity = 1.0f;
+    intensity_cloud.push_back(point);
+    buffer.insert(buffer.end(), {pt.x, pt.y, pt.z, point.intensity, 0.0f});
+  }
+
+  // Raycasting into a grid which already has the topology of the scan allocates no nodes
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid =
+    OccupancyVDBMapping::UpdateGridT::create(false);
+  OccupancyVDBMapping::UpdateGridT::Accessor acc = update_grid->getAccessor();
+  map.raycastPointCloud(scan, origin, acc);
+
+  const std::size_t start_allocations = allocation_count;
+  for (auto _ : state)
+  {
+    switch (state.range(0))
+    {
+      case 0: {
+        PointCloudT::Ptr cloud(new PointCloudT);
+        cloud->reserve(intensity_cloud.size());
+        for (const pcl::PointXYZI& point : intensity_cloud)
+        {
+          cloud->emplace_back(point.x, point.y, point.z);
+        }
+        map.raycastPointCloud(cloud, origin, acc);
+        break;
+      }
+      case 1:
+        map.raycastPointCloud(intensity_cloud, origin, acc);
+        break;
+      default:
+        map.raycastPointCloud(
+          PointSpan(buffer.data(), intensity_cloud.size(), 5 * sizeof(float)), origin, acc);
+        break;
+    }
+  }
+  setRateCounters(state, static_cast<double>(intensity_cloud.size()), 0);
+  state.counters["allocs/scan"] = static_cast<double>(allocation_count - start_allocations) /
+                                  static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_RaycastPointLayout)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Raycasting of a sensor frame scan into a reused update grid. Arguments: input (0 cloud
+ * transformed into the map frame first, 1 sensor pose applied while raycasting)
+ *
+ * The allocs/scan counter reports the heap allocations per scan.
+ */
+void BM_InsertSensorFrame(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  const Config conf = benchmarkConfig();
+  OccupancyVDBMapping map(0.1);
+  map.setConfig(conf);
+  PointCloudT::Ptr scan = spinningLidarScan(Eigen::Vector3d(0, 0, 0));
+  Eigen::Isometry3d sensor_to_map_tf =
+    Eigen::Translation3d(2.0, -1.0, 0.5) * Eigen::AngleAxisd(0.5, Eigen::Vector3d::UnitZ());
+  const Eigen::Vector3d origin = sensor_to_map_tf.translation();
+
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid =
+    OccupancyVDBMapping::UpdateGridT::create(false);
+  OccupancyVDBMapping::UpdateGridT::Accessor acc = update_grid->getAccessor();
+  map.raycastPointCloud(*scan, sensor_to_map_tf, conf.max_range, acc);
+
+  const std::size_t start_allocations = allocation_count;
+  for (auto _ : state)
+  {
+    if (state.range(0) == 0)
+    {
+      PointCloudT::Ptr cloud(new PointCloudT);
+      pcl::transformPointCloud(*scan, *cloud, sensor_to_map_tf.matrix().cast<float>().eval());
+      map.raycastPointCloud(cloud, origin, conf.max_range, acc);
+    }
+    else
+    {
+      map.raycastPointCloud(*scan, sensor_to_map_tf, conf.max_range, acc);
+    }
+  }
+  setRateCounters(state, static_cast<double>(scan->size()), 0);
+  state.counters["allocs/scan"] = static_cast<double>(allocation_count - start_allocations) /
+                                  static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_InsertSensorFrame)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Merging the update grids of two overlapping scans into a fresh grid. Arguments: scan type,
+ * resolution [cm]
+ */
+void BM_MergeUpdateGrid(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(1)) / 100.0);
+  map.setConfig(benchmarkConfig());
+  std::vector<OccupancyVDBMapping::UpdateGridT::Ptr> sources;
+  for (const Eigen::Vector3d& origin : {Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(1, 0, 0)})
+  {
+    sources.push_back(OccupancyVDBMapping::UpdateGridT::create(false));
+    OccupancyVDBMapping::UpdateGridT::Accessor acc = sources.back()->getAccessor();
+    map.raycastPointCloud(generateScan(static_cast<int>(state.range(0)), origin), origin, acc);
+  }
+
+  OccupancyVDBMapping::UpdateGridT::Ptr target;
+  for (auto _ : state)
+  {
+    target = OccupancyVDBMapping::UpdateGridT::create(false);
+    OccupancyVDBMapping::UpdateGridT::Accessor acc = target->getAccessor();
+    for (const auto& source : sources)
+    {
+      map.mergeUpdateGrid(*source, acc);
+    }
+  }
+  const double voxels =
+    static_cast<double>(sources[0]->activeVoxelCount() + sources[1]->activeVoxelCount());
+  setRateCounters(state, 0, voxels);
+}
+BENCHMARK(BM_MergeUpdateGrid)->ArgsProduct({{0, 1, 2}, {5, 10, 20}});
+
+/*!
+ * \brief Integration of an update grid into the map. Arguments: scan type, resolution [cm],
+ * integration variant (0 per voxel accessor loop with virtual rules, 1 inlined policy on leaf
+ * masks, 2 leaf parallel batches)
+ *
+ * The seconds_per_voxel counter reports the per voxel cost of the variants.
+ */
+void BM_UpdateMap(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  const double resolution = static_cast<double>(state.range(1)) / 100.0;
+  const int variant       = static_cast<int>(state.range(2));
+  std::unique_ptr<OccupancyVDBMapping> map;
+  if (variant == 0)
+  {
+    map.reset(new VirtualOccupancyVDBMapping(resolution));
+  }
+  else
+  {
+    map.reset(new OccupancyVDBMapping(resolution));
+  }
+  map->setConfig(benchmarkConfig(variant == 2));
+
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr cloud = generateScan(static_cast<int>(state.range(0)), origin);
+  OccupancyVDBMapping::UpdateGridT::Ptr update_grid =
+    OccupancyVDBMapping::UpdateGridT::create(false);
+  OccupancyVDBMapping::UpdateGridT::Accessor acc = update_grid->getAccessor();
+  map->raycastPointCloud(cloud, origin, acc);
+
+  for (auto _ : state)
+  {
+    benchmark::DoNotOptimize(map->updateMap(update_grid));
+  }
+  const double voxels = static_cast<double>(update_grid->activeVoxelCount());
+  setRateCounters(state, 0, voxels);
+  state.counters["seconds_per_voxel"] = benchmark::Counter(
+    voxels, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+BENCHMARK(BM_UpdateMap)->ArgsProduct({{0, 1, 2}, {5, 10, 20}, {0, 1, 2}});
+
+/*!
+ * \brief Raycasting or integration of a scan with the given tree layout. Arguments: scan type,
+ * resolution [cm], stage (0 raycasting, 1 integration)
+ *
+ * The update_grid_MB and map_MB counters report the tree memory of the raycast scan and of the
+ * map after its integration.
+ */
+template <typename TTreeLayout>
+void BM_TreeLayout(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  using MappingT = OccupancyVDBMappingT<TTreeLayout>;
+  MappingT map(static_cast<double>(state.range(1)) / 100.0);
+  map.setConfig(benchmarkConfig());
+  const bool integrate = state.range(2) != 0;
+
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr cloud = generateScan(static_cast<int>(state.range(0)), origin);
+  typename MappingT::UpdateGridT::Ptr update_grid = MappingT::UpdateGridT::create(false);
+  typename MappingT::UpdateGridT::Accessor acc    = update_grid->getAccessor();
+  map.raycastPointCloud(cloud, origin, acc);
+
+  for (auto _ : state)
+  {
+    if (integrate)
+    {
+      benchmark::DoNotOptimize(map.updateMap(update_grid));
+    }
+    else
+    {
+      typename MappingT::UpdateGridT::Ptr grid          = MappingT::UpdateGridT::create(false);
+      typename MappingT::UpdateGridT::Accessor grid_acc = grid->getAccessor();
+      map.raycastPointCloud(cloud, origin, grid_acc);
+      benchmark::DoNotOptimize(grid);
+    }
+  }
+  if (!integrate)
+  {
+    map.updateMap(update_grid);
+  }
+  setRateCounters(state,
+                  integrate ? 0.0 : static_cast<double>(cloud->size()),
+                  integrate ? static_cast<double>(update_grid->activeVoxelCount()) : 0.0);
+  state.counters["update_grid_MB"] =
+    static_cast<double>(update_grid->memUsage()) / (1024.0 * 1024.0);
+  state.counters["map_MB"] = static_cast<double>(map.getGrid()->memUsage()) / (1024.0 * 1024.0);
+}
+BENCHMARK_TEMPLATE(BM_TreeLayout, DefaultTreeLayout)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}, {0, 1}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TreeLayout, LongRangeTreeLayout)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}, {0, 1}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TreeLayout, IndoorTreeLayout)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}, {0, 1}})
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Index bounding boxes of a 10m window around 256 poses. Arguments: variant (0 one call per
+ * box, 1 batched call)
+ *
+ * The allocs/box counter reports the heap allocations per computed box.
+ */
+void BM_CreateBoundingBox(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(0.1);
+  const Eigen::Matrix<double, 3, 1> min_boundary(-5, -5, -2);
+  const Eigen::Matrix<double, 3, 1> max_boundary(5, 5, 2);
+  OccupancyVDBMapping::TransformVectorT tfs;
+  for (int i = 0; i < 256; ++i)
+  {
+    Eigen::Affine3d tf(Eigen::AngleAxisd(0.01 * i, Eigen::Vector3d::UnitZ()));
+    tf.translation() = Eigen::Vector3d(0.1 * i, 0.05 * i, 0);
+    tfs.push_back(tf.matrix());
+  }
+  std::vector<openvdb::CoordBBox> bounding_boxes(tfs.size());
+
+  const std::size_t start_allocations = allocation_count;
+  for (auto _ : state)
+  {
+    if (state.range(0) != 0)
+    {
+      map.createIndexBoundingBoxes(min_boundary, max_boundary, tfs, bounding_boxes);
+    }
+    else
+    {
+      for (std::size_t i = 0; i < tfs.size(); ++i)
+      {
+        bounding_boxes[i] = map.createIndexBoundingBox(min_boundary, max_boundary, tfs[i]);
+      }
+    }
+    benchmark::DoNotOptimize(bounding_boxes.data());
+  }
+  const double boxes = static_cast<double>(state.iterations() * tfs.size());
+
+  state.counters["allocs/box"] = static_cast<double>(allocation_count - start_allocations) / boxes;
+  state.counters["boxes/s"]    = benchmark::Counter(static_cast<double>(tfs.size()),
+                                                 benchmark::Counter::kIsIterationInvariantRate);
+}
+BENCHMARK(BM_CreateBoundingBox)->Arg(0)->Arg(1);
+
+/*!
+ * \brief Extraction of a 10m map section. Arguments: resolution [cm], map extent [m]
+ */
+void BM_GetMapSection(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig(true));
+  buildMap(map, static_cast<double>(state.range(1)));
+
+  const Eigen::Matrix<double, 3, 1> min_boundary(-5, -5, -5);
+  const Eigen::Matrix<double, 3, 1> max_boundary(5, 5, 5);
+  const Eigen::Matrix<double, 4, 4> tf = Eigen::Matrix<double, 4, 4>::Identity();
+  OccupancyVDBMapping::GridT::Ptr section;
+  for (auto _ : state)
+  {
+    section = map.getMapSectionGrid(min_boundary, max_boundary, tf);
+  }
+  setRateCounters(state, 0, static_cast<double>(section->activeVoxelCount()));
+  state.counters["map_voxels"] = static_cast<double>(map.getGrid()->activeVoxelCount());
+}
+BENCHMARK(BM_GetMapSection)
+  ->ArgsProduct({{5, 10, 20}, {50, 200}})
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Application of a 10m map section. Arguments: resolution [cm], map extent [m]
+ */
+void BM_ApplyMapSection(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig(true));
+  buildMap(map, static_cast<double>(state.range(1)));
+
+  OccupancyVDBMapping::GridT::Ptr section =
+    map.getMapSectionGrid(Eigen::Matrix<double, 3, 1>(-5, -5, -5),
+                          Eigen::Matrix<double, 3, 1>(5, 5, 5),
+                          Eigen::Matrix<double, 4, 4>::Identity());
+  for (auto _ : state)
+  {
+    map.applyMapSectionGrid(section);
+  }
+  setRateCounters(state, 0, static_cast<double>(section->activeVoxelCount()));
+  state.counters["map_voxels"] = static_cast<double>(map.getGrid()->activeVoxelCount());
+}
+BENCHMARK(BM_ApplyMapSection)
+  ->ArgsProduct({{5, 10, 20}, {50, 200}})
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Raytracing of 10000 rays distributed over the sphere. Arguments: resolution [cm], batched
+ * (0 loop of individual raytrace calls, 1 raytraceBatch)
+ */
+void BM_Raytrace(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig(true));
+  const Eigen::Vector3d origin(0, 0, 0);
+  map.insertPointCloud(indoorScan(origin), origin);
+  const bool batched = state.range(1) != 0;
+
+  const std::size_t num_rays = 10000;
+  const double golden_angle  = M_PI * (3.0 - std::sqrt(5.0));
+  std::vector<openvdb::Vec3d> directions;
+  for (std::size_t i = 0; i < num_rays; ++i)
+  {
+    const double z      = 1.0 - 2.0 * (i + 0.5) / num_rays;
+    const double radius = std::sqrt(1.0 - z * z);
+    directions.emplace_back(
+      radius * std::cos(golden_angle * i), radius * std::sin(golden_angle * i), z);
+  }
+
+  const openvdb::Vec3d ray_origin(0.5, 0.5, 0.0);
+  const std::vector<openvdb::Vec3d> ray_origins(num_rays, ray_origin);
+  std::vector<openvdb::Vec3d> end_points(num_rays);
+  std::vector<double> distances(num_rays);
+  std::unique_ptr<bool[]> hit_flags(new bool[num_rays]);
+  std::size_t hits = 0;
+  for (auto _ : state)
+  {
+    if (batched)
+    {
+      map.raytraceBatch(ray_origins.data(),
+                        directions.data(),
+                        num_rays,
+                        20.0,
+                        end_points.data(),
+                        distances.data(),
+                        hit_flags.get());
+      hits += hit_flags[0];
+      continue;
+    }
+    for (std::size_t i = 0; i < num_rays; ++i)
+    {
+      hits += map.raytrace(ray_origin, directions[i], 20.0, end_points[i]);
+    }
+  }
+  benchmark::DoNotOptimize(hits);
+  state.counters["rays/s"] = benchmark::Counter(static_cast<double>(num_rays),
+                                                benchmark::Counter::kIsIterationInvariantRate);
+  setRateCounters(state, 0, 0);
+}
+BENCHMARK(BM_Raytrace)
+  ->ArgsProduct({{5, 10, 20}, {0, 1}})
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+/*!
+ * \brief Saving a map to disk. Arguments: resolution [cm], map extent [m]
+ */
+void BM_SaveMap(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  Config conf             = benchmarkConfig(true);
+  conf.map_directory_path = temporaryDirectory();
+  map.setConfig(conf);
+  buildMap(map, static_cast<double>(state.range(1)));
+
+  for (auto _ : state)
+  {
+    map.saveMap();
+  }
+  setRateCounters(state, 0, static_cast<double>(map.getGrid()->activeVoxelCount()));
+}
+BENCHMARK(BM_SaveMap)->ArgsProduct({{10, 20}, {50, 200}})->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Loading a map from disk. Arguments: resolution [cm], map extent [m]
+ */
+void BM_LoadMap(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig(true));
+  buildMap(map, static_cast<double>(state.range(1)));
+
+  const std::string file_path = temporaryDirectory() + "map.vdb";
+  openvdb::io::File file_handle(file_path);
+  openvdb::GridPtrVec grids;
+  grids.push_back(map.getGrid());
+  file_handle.write(grids);
+  file_handle.close();
+
+  for (auto _ : state)
+  {
+    map.loadMap(file_path);
+  }
+  setRateCounters(state, 0, static_cast<double>(map.getGrid()->activeVoxelCount()));
+  std::remove(file_path.c_str());
+}
+BENCHMARK(BM_LoadMap)->ArgsProduct({{10, 20}, {50, 200}})->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Log-odds represented by a voxel value of the float map
+ */
+float voxelLogOdds(const OccupancyVDBMapping& /*map*/, const float value)
+{
+  return value;
+}
+
+/*!
+ * \brief Log-odds represented by a voxel value of a quantized map
+ */
+template <typename TQuantized>
+float voxelLogOdds(const QuantizedOccupancyVDBMappingT<TQuantized>& map, const TQuantized value)
+{
+  return map.logOdds(value);
+}
+
+/*!
+ * \brief Integration of eight scans along a trajectory into an empty map with the given voxel
+ * type. Arguments: scan type, resolution [cm]
+ *
+ * The leaf_MB and map_MB counters report the memory of the leaf buffers and of the whole map. The
+ * state_mismatch and logodds_error counters report the fraction of voxels whose active state
+ * differs from the float map and the mean absolute log-odds deviation from it.
+ */
+template <typename TMapping>
+void BM_QuantizedOccupancy(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  using LeafT             = typename TMapping::GridT::TreeType::LeafNodeType;
+  const double resolution = static_cast<double>(state.range(1)) / 100.0;
+  TMapping map(resolution);
+  map.setConfig(benchmarkConfig());
+  OccupancyVDBMapping reference(resolution);
+  reference.setConfig(benchmarkConfig());
+
+  std::vector<typename TMapping::UpdateGridT::Ptr> update_grids;
+  double voxels = 0;
+  for (int i = 0; i < 8; ++i)
+  {
+    const Eigen::Vector3d origin(0.5 * i, 0.25 * i, 0);
+    update_grids.push_back(TMapping::UpdateGridT::create(false));
+    typename TMapping::UpdateGridT::Accessor acc = update_grids.back()->getAccessor();
+    map.raycastPointCloud(generateScan(static_cast<int>(state.range(0)), origin), origin, acc);
+    voxels += static_cast<double>(update_grids.back()->activeVoxelCount());
+  }
+
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    map.resetMap();
+    state.ResumeTiming();
+    for (const auto& update_grid : update_grids)
+    {
+      benchmark::DoNotOptimize(map.updateMap(update_grid));
+    }
+  }
+  setRateCounters(state, 0, voxels);
+
+  for (const auto& update_grid : update_grids)
+  {
+    reference.updateMap(update_grid);
+  }
+  double mismatches = 0;
+  double error      = 0;
+
+  typename TMapping::GridT::ConstAccessor acc = map.getGrid()->getConstAccessor();
+  for (auto iter = reference.getGrid()->cbeginValueOn(); iter; ++iter)
+  {
+    mismatches += acc.isValueOn(iter.getCoord()) ? 0.0 : 1.0;
+  }
+  for (auto iter = map.getGrid()->cbeginValueOn(); iter; ++iter)
+  {
+    mismatches += reference.getGrid()->tree().isValueOn(iter.getCoord()) ? 0.0 : 1.0;
+  }
+  for (auto leaf = reference.getGrid()->tree().cbeginLeaf(); leaf; ++leaf)
+  {
+    for (auto iter = leaf->cbeginValueAll(); iter; ++iter)
+    {
+      error += std::abs(voxelLogOdds(map, acc.getValue(iter.getCoord())) - *iter);
+    }
+  }
+  const double leaf_count = static_cast<double>(map.getGrid()->tree().leafCount());
+  const double megabyte   = 1024.0 * 1024.0;
+  state.counters["state_mismatch"] =
+    mismatches / static_cast<double>(reference.getGrid()->activeVoxelCount());
+  state.counters["logodds_error"] = error / (leaf_count * LeafT::SIZE);
+  state.counters["leaf_MB"]       = leaf_count * sizeof(LeafT) / megabyte;
+  state.counters["map_MB"]        = static_cast<double>(map.getGrid()->memUsage()) / megabyte;
+}
+BENCHMARK_TEMPLATE(BM_QuantizedOccupancy, OccupancyVDBMapping)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_QuantizedOccupancy, Int16OccupancyVDBMapping)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}})
+  ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_QuantizedOccupancy, Int8OccupancyVDBMapping)
+  ->ArgsProduct({{0, 1, 2}, {5, 10}})
+  ->Unit(benchmark::kMillisecond);
+
+/*!
+ * \brief Full pruning pass over a map whose free space in front of a depth camera saturated.
+ * Arguments: resolution [cm], budget per pruning step [us]
+ *
+ * The reclaimed_MB and collapsed_leaves counters report the result of the pass, max_step_us the
+ * longest single pruning step, which bounds the delay of the next scan integration.
+ */
+void BM_PruneMap(benchmark::State& state)
+{
+  resetPeakResidentSetSize();
+  using ClockT   = std::chrono::steady_clock;
+  using SecondsT = std::chrono::duration<double>;
+  OccupancyVDBMapping map(static_cast<double>(state.range(0)) / 100.0);
+  map.setConfig(benchmarkConfig());
+  const std::chrono::microseconds budget(state.range(1));
+  const Eigen::Vector3d origin(0, 0, 0);
+  PointCloudT::Ptr cloud = depthCameraScan(origin);
+
+  PruneStatistics pass;
+  SecondsT max_step(0);
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    map.resetMap();
+    // Twelve misses saturate a voxel at the lower clamping bound
+    for (int i = 0; i < 12; ++i)
+    {
+      map.insertPointCloud(cloud, origin);
+    }
+    pass = PruneStatistics();
+    state.ResumeTiming();
+
+    PruneStatistics step;
+    while (!step.complete)
+    {
+      const ClockT::time_point start = ClockT::now();
+      step                           = map.pruneMap(budget);
+      max_step                       = std::max<SecondsT>(max_step, ClockT::now() - start);
+      pass.collapsed_leaves += step.collapsed_leaves;
+      pass.reclaimed_bytes += step.reclaimed_bytes;
+    }
+  }
+  const double megabyte              = 1024.0 * 1024.0;
+  state.counters["reclaimed_MB"]     = static_cast<double>(pass.reclaimed_bytes) / megabyte;
+  state.counters["collapsed_leaves"] = static_cast<double>(pass.collapsed_leaves);
+  state.counters["max_step_us"]      = max_step.count() * 1e6;
+  state.counters["map_MB"]           = static_cast<double>(map.getGrid()->memUsage()) / megabyte;
+}
+BENCHMARK(BM_PruneMap)->ArgsProduct({{5, 10}, {100, 1000}})->Unit(benchmark::kMillisecond);
+
+} // namespace benchmarks
+} // namespace vdb_mapping
+
+BENCHMARK_MAIN();
@@ -0,0 +1,200 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * Deterministic synthetic sensor scans used by the benchmarks.
+ *
+ */
+//----------------------------------------------------------------------
+#ifndef VDB_MAPPING_BENCHMARKS_SCAN_GENERATORS_H_INCLUDED
+#define VDB_MAPPING_BENCHMARKS_SCAN_GENERATORS_H_INCLUDED
+
+#include <vdb_mapping/OccupancyVDBMapping.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace vdb_mapping {
+namespace benchmarks {
+
+using PointCloudT = OccupancyVDBMapping::PointCloudT;
+
+/*!
+ * \brief Distance along a ray to the walls, floor and ceiling of an axis aligned room
+ *
+ * \param origin Ray origin inside the room
+ * \param direction Unit ray direction
+ * \param room_min Minimum corner of the room
+ * \param room_max Maximum corner of the room
+ *
+ * \returns Distance to the first surface hit by the ray
+ */
+inline double rayBoxDistance(const Eigen::Vector3d& origin,
+                             const Eigen::Vector3d& direction,
+                             const Eigen::Vector3d& room_min,
+                             const Eigen::Vector3d& room_max)
+{
+  double distance = std::numeric_limits<double>::max();
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (direction[axis] > 1e-9)
+    {
+      distance = std::min(distance, (room_max[axis] - origin[axis]) / direction[axis]);
+    }
+    else if (direction[axis] < -1e-9)
+    {
+      distance = std::min(distance, (room_min[axis] - origin[axis]) / direction[axis]);
+    }
+  }
+  return distance;
+}
+
+/*!
+ * \brief Generates a scan of a spinning multi beam lidar in an outdoor scene
+ *
+ * The scene consists of a ground plane 1.8m below the sensor and an undulating wall surrounding
+ * the sensor. Parts of the wall lie beyond the given range, so some rays exceed common max ranges.
+ *
+ * \param origin Sensor position in map coordinates
+ * \param beams Number of vertical beams
+ * \param columns Number of measurements per beam and revolution
+ * \param range Mean distance of the surrounding wall
+ *
+ * \returns Point cloud in map coordinates
+ */
+inline PointCloudT::Ptr spinningLidarScan(const Eigen::Vector3d& origin,
+                                          const int beams   = 128,
+                                          const int columns = 2048,
+                                          const double range = 30.0)
+{
+  PointCloudT::Ptr cloud(new PointCloudT);
+  cloud->points.reserve(static_cast<std::size_t>(beams) * columns);
+  const double min_elevation = -22.5 * M_PI / 180.0;
+  const double max_elevation = 22.5 * M_PI / 180.0;
+  for (int beam = 0; beam < beams; ++beam)
+  {
+    const double elevation =
+      min_elevation + (max_elevation - min_elevation) * beam / std::max(1, beams - 1);
+    for (int column = 0; column < columns; ++column)
+    {
+      const double azimuth = 2.0 * M_PI * column / columns;
+      const Eigen::Vector3d direction(std::cos(elevation) * std::cos(azimuth),
+                                      std::cos(elevation) * std::sin(azimuth),
+                                      std::sin(elevation));
+      const double wall_radius = range * (0.7 + 0.4 * std::sin(3.0 * azimuth));
+      double distance          = wall_radius / std::max(std::cos(elevation), 1e-3);
+      if (direction.z() < 0.0)
+      {
+        distance = std::min(distance, -1.8 / direction.z());
+      }
+      const Eigen::Vector3d point = origin + distance * direction;
+      cloud->points.emplace_back(static_cast<float>(point.x()),
+                                 static_cast<float>(point.y()),
+                                 static_cast<float>(point.z()));
+    }
+  }
+  cloud->width  = static_cast<std::uint32_t>(cloud->points.size());
+  cloud->height = 1;
+  return cloud;
+}
+
+/*!
+ * \brief Generates a scan of a depth camera looking along the x axis at a wall with a box
+ *
+ * \param origin Sensor position in map coordinates
+ * \param width Horizontal image resolution
+ * \param height Vertical image resolution
+ * \param distance Distance of the wall in front of the camera
+ *
+ * \returns Point cloud in map coordinates
+ */
+inline PointCloudT::Ptr depthCameraScan(const Eigen::Vector3d& origin,
+                                        const int width       = 640,
+                                        const int height      = 480,
+                                        const double distance = 4.0)
+{
+  PointCloudT::Ptr cloud(new PointCloudT);
+  cloud->points.reserve(static_cast<std::size_t>(width) * height);
+  const double focal_length = 0.5 * width / std::tan(0.5 * 87.0 * M_PI / 180.0);
+  for (int v = 0; v < height; ++v)
+  {
+    for (int u = 0; u < width; ++u)
+    {
+      const double y = (u - 0.5 * width) / focal_length;
+      const double z = (0.5 * height - v) / focal_length;
+      // A box in the center of the image is placed in front of the wall
+      double depth = distance;
+      if (std::abs(y) < 0.2 && std::abs(z) < 0.2)
+      {
+        depth = 0.5 * distance;
+      }
+      cloud->points.emplace_back(static_cast<float>(origin.x() + depth),
+                                 static_cast<float>(origin.y() + depth * y),
+                                 static_cast<float>(origin.z() + depth * z));
+    }
+  }
+  cloud->width  = static_cast<std::uint32_t>(width);
+  cloud->height = static_cast<std::uint32_t>(height);
+  return cloud;
+}
+
+/*!
+ * \brief Generates a dense omnidirectional scan of a closed indoor room
+ *
+ * Rays are distributed uniformly over the sphere on a Fibonacci lattice and end on the walls,
+ * floor or ceiling of the room.
+ *
+ * \param origin Sensor position inside the room
+ * \param num_points Number of generated points
+ * \param room_min Minimum corner of the room
+ * \param room_max Maximum corner of the room
+ *
+ * \returns Point cloud in map coordinates
+ */
+inline PointCloudT::Ptr indoorScan(const Eigen::Vector3d& origin,
+                                   const int num_points            = 500000,
+                                   const Eigen::Vector3d& room_min = Eigen::Vector3d(-5, -4, -1.5),
+                                   const Eigen::Vector3d& room_max = Eigen::Vector3d(5, 4, 1.5))
+{
+  PointCloudT::Ptr cloud(new PointCloudT);
+  cloud->points.reserve(static_cast<std::size_t>(num_points));
+  const double golden_angle = M_PI * (3.0 - std::sqrt(5.0));
+  for (int i = 0; i < num_points; ++i)
+  {
+    const double z      = 1.0 - 2.0 * (i + 0.5) / num_points;
+    const double radius = std::sqrt(1.0 - z * z);
+    const double theta  = golden_angle * i;
+    const Eigen::Vector3d direction(radius * std::cos(theta), radius * std::sin(theta), z);
+    const Eigen::Vector3d point =
+      origin + rayBoxDistance(origin, direction, room_min, room_max) * direction;
+    cloud->points.emplace_back(static_cast<float>(point.x()),
+                               static_cast<float>(point.y()),
+                               static_cast<float>(point.z()));
+  }
+  cloud->width  = static_cast<std::uint32_t>(cloud->points.size());
+  cloud->height = 1;
+  return cloud;
+}
+
+} // namespace benchmarks
+} // namespace vdb_mapping
+
+#endif /* VDB_MAPPING_BENCHMARKS_SCAN_GENERATORS_H_INCLUDED */
@@ -0,0 +1,264 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * \author  Marvin Große Besselmann grosse@fzi.de
+ * \author  Lennart Puck puck@fzi.de
+ * \date    2021-04-29
+ *
+ */
+//----------------------------------------------------------------------
+#ifndef VDB_MAPPING_INGESTION_PIPELINE_H_INCLUDED
+#define VDB_MAPPING_INGESTION_PIPELINE_H_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <eigen3/Eigen/Core>
+
+namespace vdb_mapping {
+
+/*!
+ * \brief Behaviour of the pipeline once its input queue is full
+ */
+enum class BackpressurePolicy
+{
+  /*!
+   * \brief The caller waits until the raycasting stage takes a scan from the queue
+   */
+  BLOCK,
+  /*!
+   * \brief The oldest queued scan is discarded in favour of the new one
+   */
+  DROP,
+  /*!
+   * \brief The new scan is appended to the newest queued batch and integrated together with it
+   */
+  MERGE
+};
+
+/*!
+ * \brief Configuration of the ingestion pipeline
+ */
+struct PipelineConfig
+{
+  /*!
+   * \brief Number of batches each stage queue can hold
+   */
+  std::size_t queue_capacity      = 4;
+  BackpressurePolicy backpressure = BackpressurePolicy::BLOCK;
+  /*!
+   * \brief Time slice in which the integration stage prunes the map while it waits for scans, see
+   * VDBMapping::pruneMap. Zero disables the pruning
+   */
+  std::chrono::microseconds prune_budget = std::chrono::microseconds(0);
+};
+
+/*!
+ * \brief Counters of a single pipeline stage. Latencies are given in seconds.
+ */
+struct StageStatistics
+{
+  std::size_t processed       = 0;
+  double mean_latency         = 0.0;
+  double max_latency          = 0.0;
+  std::size_t queue_depth     = 0;
+  std::size_t max_queue_depth = 0;
+};
+
+/*!
+ * \brief Counters of the whole pipeline
+ */
+struct PipelineStatistics
+{
+  StageStatistics raycast;
+  StageStatistics integrate;
+  StageStatistics publish;
+  std::size_t submitted = 0;
+  std::size_t dropped   = 0;
+  std::size_t merged    = 0;
+  /*!
+   * \brief Leaves collapsed into tiles by the pruning and their freed memory
+   */
+  std::size_t pruned_leaves   = 0;
+  std::size_t reclaimed_bytes = 0;
+  /*!
+   * \brief Time from submission of a batch until its publish stage finished
+   */
+  double mean_end_to_end_latency = 0.0;
+  double max_end_to_end_latency  = 0.0;
+};
+
+/*!
+ * \brief Pipelined point cloud ingestion for a VDBMapping
+ *
+ * Raycasting, map integration and publishing run on separate threads, so the raycasting of scan
+ * N+1 overlaps with the integration of scan N. Each scan is raycast into its own update grid and
+ * integrated via VDBMapping::integrateUpdate. Only the integration stage writes to the map, which
+ * therefore must not be modified by other threads while the pipeline is running. Concurrent
+ * readers should use map snapshots. If a prune budget is configured, the integration stage prunes
+ * the map in slices of that budget whenever no raycast scan is waiting. The pruning pauses once a
+ * pass over all leaves completed and resumes after the next map update.
+ */
+template <typename TMapping>
+class IngestionPipeline
+{
+public:
+  using PointCloudT = typename TMapping::PointCloudT;
+  using UpdateGridT = typename TMapping::UpdateGridT;
+  /*!
+   * \brief Called by the publish stage with the update and overwrite grid of each batch
+   */
+  using PublishCallback = std::function<void(const typename UpdateGridT::Ptr& update_grid,
+                                             const typename UpdateGridT::Ptr& overwrite_grid)>;
+
+  /*!
+   * \brief Starts the stage threads
+   *
+   * \param mapping Configured map the scans are integrated into
+   * \param config Pipeline configuration
+   * \param publish Optional callback of the publish stage
+   */
+  IngestionPipeline(TMapping& mapping,
+                    const PipelineConfig& config   = PipelineConfig(),
+                    const PublishCallback& publish = PublishCallback());
+  IngestionPipeline(const IngestionPipeline&) = delete;
+  IngestionPipeline& operator=(const IngestionPipeline&) = delete;
+
+  /*!
+   * \brief Processes all queued scans and stops the stage threads
+   */
+  virtual ~IngestionPipeline();
+
+  /*!
+   * \brief Queues a point cloud for integration, applying the backpressure policy if the queue
+   * is full
+   *
+   * \param cloud Input cloud in map coordinates
+   * \param origin Sensor position in map coordinates
+   * \param max_range Maximum raycasting range, the configured range is used if not positive
+   *
+   * \returns False if the pipeline was already stopped
+   */
+  bool insertPointCloud(const typename PointCloudT::ConstPtr& cloud,
+                        const Eigen::Matrix<double, 3, 1>& origin,
+                        const double max_range = 0.0);
+
+  /*!
+   * \brief Blocks until every queued scan has passed the publish stage
+   */
+  void flush();
+
+  /*!
+   * \brief Processes all queued scans and joins the stage threads. Further scans are rejected.
+   */
+  void stop();
+
+  /*!
+   * \brief Returns a consistent copy of the current counters
+   */
+  PipelineStatistics statistics() const;
+
+private:
+  using ClockT = std::chrono::steady_clock;
+
+  struct Scan
+  {
+    typename PointCloudT::ConstPtr cloud;
+    Eigen::Matrix<double, 3, 1> origin;
+    double max_range;
+  };
+
+  struct Batch
+  {
+    std::vector<Scan> scans;
+    ClockT::time_point submitted;
+  };
+
+  struct Result
+  {
+    typename UpdateGridT::Ptr update_grid;
+    typename UpdateGridT::Ptr overwrite_grid;
+    ClockT::time_point submitted;
+  };
+
+  void raycastStage();
+  void integrateStage();
+  void publishStage();
+
+  /*!
+   * \brief Blocks until a queue has an element or its producing stage finished
+   *
+   * \returns False if the queue is empty and will stay empty
+   */
+  template <typename TItem>
+  bool pop(std::unique_lock<std::mutex>& lock,
+           std::deque<TItem>& queue,
+           const bool& producer_done,
+           TItem& item);
+
+  /*!
+   * \brief Blocks until a queue has room and appends the item
+   */
+  template <typename TItem>
+  void push(std::unique_lock<std::mutex>& lock,
+            std::deque<TItem>& queue,
+            StageStatistics& stats,
+            TItem&& item);
+
+  void recordLatency(StageStatistics& stats, const ClockT::time_point& start);
+
+  TMapping& m_mapping;
+  PipelineConfig m_config;
+  PublishCallback m_publish;
+
+  mutable std::mutex m_mutex;
+  std::condition_variable m_condition;
+  std::deque<Batch> m_raycast_queue;
+  std::deque<Result> m_integrate_queue;
+  std::deque<Result> m_publish_queue;
+  /*!
+   * \brief Batches accepted but not yet published
+   */
+  std::size_t m_pending;
+  bool m_stopping;
+  bool m_raycast_done;
+  bool m_integrate_done;
+
+  PipelineStatistics m_statistics;
+
+  std::thread m_raycast_thread;
+  std::thread m_integrate_thread;
+  std::thread m_publish_thread;
+};
+
+#include "IngestionPipeline.hpp"
+
+} // namespace vdb_mapping
+
+#endif /* VDB_MAPPING_INGESTION_PIPELINE_H_INCLUDED */
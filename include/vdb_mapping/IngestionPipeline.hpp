@@ -0,0 +1,289 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * \author  Marvin Große Besselmann grosse@fzi.de
+ * \author  Lennart Puck puck@fzi.de
+ * \date    2021-04-29
+ *
+ */
+//----------------------------------------------------------------------
+
+template <typename TMapping>
+IngestionPipeline<TMapping>::IngestionPipeline(TMapping& mapping,
+                                               const PipelineConfig& config,
+                                               const PublishCallback& publish)
+  : m_mapping(mapping)
+  , m_config(config)
+  , m_publish(publish)
+  , m_pending(0)
+  , m_stopping(false)
+  , m_raycast_done(false)
+  , m_integrate_done(false)
+{
+  m_config.queue_capacity = std::max<std::size_t>(m_config.queue_capacity, 1);
+  m_raycast_thread        = std::thread(&IngestionPipeline::raycastStage, this);
+  m_integrate_thread      = std::thread(&IngestionPipeline::integrateStage, this);
+  m_publish_thread        = std::thread(&IngestionPipeline::publishStage, this);
+}
+
+template <typename TMapping>
+IngestionPipeline<TMapping>::~IngestionPipeline()
+{
+  stop();
+}
+
+template <typename TMapping>
+bool IngestionPipeline<TMapping>::insertPointCloud(const typename PointCloudT::ConstPtr& cloud,
+                                                   const Eigen::Matrix<double, 3, 1>& origin,
+                                                   const double max_range)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_stopping)
+  {
+    return false;
+  }
+  ++m_statistics.submitted;
+  Scan scan{cloud, origin, max_range};
+
+  if (m_raycast_queue.size() >= m_config.queue_capacity)
+  {
+    switch (m_config.backpressure)
+    {
+      case BackpressurePolicy::DROP:
+        m_raycast_queue.pop_front();
+        --m_pending;
+        ++m_statistics.dropped;
+        break;
+      case BackpressurePolicy::MERGE:
+        // The batch is raycast into a single update grid, so its scans share one map update
+        m_raycast_queue.back().scans.push_back(std::move(scan));
+        ++m_statistics.merged;
+        return true;
+      case BackpressurePolicy::BLOCK:
+        m_condition.wait(lock, [this] {
+          return m_stopping || m_raycast_queue.size() < m_config.queue_capacity;
+        });
+        if (m_stopping)
+        {
+          return false;
+        }
+        break;
+    }
+  }
+
+  Batch batch;
+  batch.scans.push_back(std::move(scan));
+  batch.submitted = ClockT::now();
+  ++m_pending;
+  m_raycast_queue.push_back(std::move(batch));
+  m_statistics.raycast.max_queue_depth =
+    std::max(m_statistics.raycast.max_queue_depth, m_raycast_queue.size());
+  m_condition.notify_all();
+  return true;
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_condition.wait(lock, [this] { return m_pending == 0; });
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all();
+  for (std::thread* thread : {&m_raycast_thread, &m_integrate_thread, &m_publish_thread})
+  {
+    if (thread->joinable())
+    {
+      thread->join();
+    }
+  }
+}
+
+template <typename TMapping>
+PipelineStatistics IngestionPipeline<TMapping>::statistics() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  PipelineStatistics statistics    = m_statistics;
+  statistics.raycast.queue_depth   = m_raycast_queue.size();
+  statistics.integrate.queue_depth = m_integrate_queue.size();
+  statistics.publish.queue_depth   = m_publish_queue.size();
+  return statistics;
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::raycastStage()
+{
+  Batch batch;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!pop(lock, m_raycast_queue, m_stopping, batch))
+      {
+        m_raycast_done = true;
+        m_condition.notify_all();
+        return;
+      }
+    }
+
+    // Raycasting only reads the map configuration, so it can run while the map is integrated
+    const ClockT::time_point start = ClockT::now();
+    Result result;
+    result.update_grid = UpdateGridT::create(false);
+    result.submitted   = batch.submitted;
+    {
+      typename UpdateGridT::Accessor update_grid_acc = result.update_grid->getAccessor();
+      for (const Scan& scan : batch.scans)
+      {
+        if (scan.max_range > 0)
+        {
+          m_mapping.raycastPointCloud(scan.cloud, scan.origin, scan.max_range, update_grid_acc);
+        }
+        else
+        {
+          m_mapping.raycastPointCloud(scan.cloud, scan.origin, update_grid_acc);
+        }
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    recordLatency(m_statistics.raycast, start);
+    push(lock, m_integrate_queue, m_statistics.integrate, std::move(result));
+  }
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::integrateStage()
+{
+  Result result;
+  bool prune_pending = false;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (prune_pending && m_integrate_queue.empty() && !m_raycast_done)
+      {
+        // Only this stage writes to the map, so it can be pruned while no scan is waiting
+        lock.unlock();
+        const auto pruned = m_mapping.pruneMap(m_config.prune_budget);
+        prune_pending     = !pruned.complete;
+        lock.lock();
+        m_statistics.pruned_leaves += pruned.collapsed_leaves;
+        m_statistics.reclaimed_bytes += pruned.reclaimed_bytes;
+        continue;
+      }
+      if (!pop(lock, m_integrate_queue, m_raycast_done, result))
+      {
+        m_integrate_done = true;
+        m_condition.notify_all();
+        return;
+      }
+    }
+
+    const ClockT::time_point start = ClockT::now();
+    result.overwrite_grid          = m_mapping.integrateUpdate(result.update_grid);
+    prune_pending                  = m_config.prune_budget.count() > 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    recordLatency(m_statistics.integrate, start);
+    push(lock, m_publish_queue, m_statistics.publish, std::move(result));
+  }
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::publishStage()
+{
+  Result result;
+  while (true)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!pop(lock, m_publish_queue, m_integrate_done, result))
+      {
+        return;
+      }
+    }
+
+    const ClockT::time_point start = ClockT::now();
+    if (m_publish)
+    {
+      m_publish(result.update_grid, result.overwrite_grid);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    recordLatency(m_statistics.publish, start);
+    const double latency =
+      std::chrono::duration<double>(ClockT::now() - result.submitted).count();
+    m_statistics.mean_end_to_end_latency +=
+      (latency - m_statistics.mean_end_to_end_latency) / m_statistics.publish.processed;
+    m_statistics.max_end_to_end_latency = std::max(m_statistics.max_end_to_end_latency, latency);
+    --m_pending;
+    m_condition.notify_all();
+  }
+}
+
+template <typename TMapping>
+template <typename TItem>
+bool IngestionPipeline<TMapping>::pop(std::unique_lock<std::mutex>& lock,
+                                      std::deque<TItem>& queue,
+                                      const bool& producer_done,
+                                      TItem& item)
+{
+  m_condition.wait(lock, [&] { return producer_done || !queue.empty(); });
+  if (queue.empty())
+  {
+    return false;
+  }
+  item = std::move(queue.front());
+  queue.pop_front();
+  m_condition.notify_all();
+  return true;
+}
+
+template <typename TMapping>
+template <typename TItem>
+void IngestionPipeline<TMapping>::push(std::unique_lock<std::mutex>& lock,
+                                       std::deque<TItem>& queue,
+                                       StageStatistics& stats,
+                                       TItem&& item)
+{
+  m_condition.wait(lock, [&] { return queue.size() < m_config.queue_capacity; });
+  queue.push_back(std::move(item));
+  stats.max_queue_depth = std::max(stats.max_queue_depth, queue.size());
+  m_condition.notify_all();
+}
+
+template <typename TMapping>
+void IngestionPipeline<TMapping>::recordLatency(StageStatistics& stats,
+                                                const ClockT::time_point& start)
+{
+  const double latency = std::chrono::duration<double>(ClockT::now() - start).count();
+  ++stats.processed;
+  stats.mean_latency += (latency - stats.mean_latency) / stats.processed;
+  stats.max_latency = std::max(stats.max_latency, latency);
+}
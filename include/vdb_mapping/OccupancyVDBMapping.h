@@ -44,11 +44,111 @@ struct Config : BaseConfig
   bool   static_env;
 };
 
-class OccupancyVDBMapping : public VDBMapping<float, Config>
+/*!
+ * \brief Log-odds occupancy update rules
+ */
+struct OccupancyUpdatePolicy : VoxelUpdatePolicy<OccupancyUpdatePolicy>
+{
+  using LeafT        = VDBMapping<float, Config>::GridT::TreeType::LeafNodeType;
+  using NodeMaskType = LeafT::NodeMaskType;
+
+  /*!
+   * \brief Implementations of the leaf update
+   */
+  enum class LeafKernel
+  {
+    AUTO,
+    SCALAR,
+    AVX2
+  };
+
+  /*!
+   * \brief Checks whether a leaf kernel can be executed on this CPU
+   *
+   * \param kernel Leaf kernel to check
+   *
+   * \returns True if the kernel is compiled in and supported by the CPU
+   */
+  static bool leafKernelSupported(const LeafKernel kernel);
+
+  /*!
+   * \brief Applies the log-odds update to all updated voxels of a map leaf at once
+   *
+   * The leaf buffer is processed in blocks of 64 voxels, adding and clamping the log-odds with
+   * masked AVX2 instructions if the CPU supports them and with a scalar loop otherwise, unless
+   * leaf_kernel selects the scalar loop. The new active states are derived from the threshold
+   * comparisons as bit masks.
+   *
+   * \param update_mask Mask of all voxels of the leaf which shall be updated
+   * \param hit_mask Mask of all updated voxels which are sensor hits
+   * \param leaf Map leaf which is updated
+   * \param change_mask Mask in which all voxels with a changed active state are set
+   */
+  void updateLeaf(const NodeMaskType& update_mask,
+                  const NodeMaskType& hit_mask,
+                  LeafT& leaf,
+                  NodeMaskType& change_mask) const;
+
+  bool updateFreeNode(float& voxel_value, bool& active) const
+  {
+    voxel_value += logodds_miss;
+    if (voxel_value < logodds_thres_min)
+    {
+      active = false;
+      if (voxel_value < min_logodds)
+      {
+        voxel_value = min_logodds;
+      }
+    }
+    return true;
+  }
+
+  bool updateOccupiedNode(float& voxel_value, bool& active) const
+  {
+    voxel_value += logodds_hit;
+    if (voxel_value > logodds_thres_max)
+    {
+      active = true;
+      if (voxel_value > max_logodds)
+      {
+        voxel_value = max_logodds;
+      }
+    }
+    return true;
+  }
+
+  float logodds_hit;
+  float logodds_miss;
+  float logodds_thres_min;
+  float logodds_thres_max;
+  float max_logodds;
+  float min_logodds;
+  /*!
+   * \brief Kernel used by updateLeaf, AVX2 falls back to the scalar loop if it is not supported
+   */
+  LeafKernel leaf_kernel = LeafKernel::AUTO;
+};
+
+/*!
+ * \brief Log-odds occupancy map
+ *
+ * \tparam TTreeLayout Node dimensions of the map and update trees, see TreeLayout
+ */
+template <typename TTreeLayout = DefaultTreeLayout>
+class OccupancyVDBMappingT : public VDBMapping<float, Config, TTreeLayout>
 {
 public:
-  OccupancyVDBMapping(const double resolution)
-    : VDBMapping<float, Config>(resolution)
+  using BaseT       = VDBMapping<float, Config, TTreeLayout>;
+  using UpdateGridT = typename BaseT::UpdateGridT;
+
+  OccupancyVDBMappingT(const double resolution)
+    : BaseT(resolution)
+    , m_logodds_hit(0)
+    , m_logodds_miss(0)
+    , m_logodds_thres_min(0)
+    , m_logodds_thres_max(0)
+    , m_max_logodds(0)
+    , m_min_logodds(0)
   {
   }
 
@@ -59,10 +159,27 @@ public:
    */
   void setConfig(const Config& config) override;
 
+  /*!
+   * \brief Incorporates the information of an update grid to the internal map using the inlined
+   * log-odds update rules
+   *
+   * \param temp_grid Grid containing all cells which shall be updated
+   *
+   * \returns Grid containing all voxels whose active state changed
+   */
+  typename UpdateGridT::Ptr updateMap(const typename UpdateGridT::Ptr& temp_grid) override;
+
 protected:
   bool updateFreeNode(float& voxel_value, bool& active) override;
   bool updateOccupiedNode(float& voxel_value, bool& active) override;
 
+  /*!
+   * \brief Creates the update policy from the current log-odds parameters
+   *
+   * \returns Occupancy update policy
+   */
+  OccupancyUpdatePolicy updatePolicy() const;
+
   /*!
    * \brief Probability update value for passing an obstacle
    */
@@ -89,6 +206,24 @@ protected:
   float m_min_logodds;
 };
 
+#include "OccupancyVDBMapping.hpp"
+
+// The presets are compiled into the library
+extern template class OccupancyVDBMappingT<DefaultTreeLayout>;
+extern template class OccupancyVDBMappingT<LongRangeTreeLayout>;
+extern template class OccupancyVDBMappingT<IndoorTreeLayout>;
+
+/*!
+ * \brief Occupancy map with the default tree layout
+ *
+ * A class of its own instead of an alias, so that it can still be forward declared.
+ */
+class OccupancyVDBMapping : public OccupancyVDBMappingT<DefaultTreeLayout>
+{
+public:
+  using OccupancyVDBMappingT<DefaultTreeLayout>::OccupancyVDBMappingT;
+};
+
 } // namespace vdb_mapping
 
 #endif /* VDB_MAPPING_OCCUPANCY_VDB_MAPPING_H_INCLUDED */
@@ -0,0 +1,192 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * \author  Marvin Große Besselmann grosse@fzi.de
+ * \author  Lennart Puck puck@fzi.de
+ * \date    2021-04-29
+ *
+ */
+//----------------------------------------------------------------------
+#ifndef VDB_MAPPING_QUANTIZED_OCCUPANCY_VDB_MAPPING_H_INCLUDED
+#define VDB_MAPPING_QUANTIZED_OCCUPANCY_VDB_MAPPING_H_INCLUDED
+
+#include "vdb_mapping/OccupancyVDBMapping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace vdb_mapping {
+
+/*!
+ * \brief Saturating fixed-point log-odds occupancy update rules
+ *
+ * All parameters are given in quantization steps. The sums are formed in 32 bit, so they cannot
+ * overflow before they are clamped to the value range of the voxel type.
+ */
+template <typename TQuantized>
+struct QuantizedOccupancyUpdatePolicy
+  : VoxelUpdatePolicy<QuantizedOccupancyUpdatePolicy<TQuantized> >
+{
+  bool updateFreeNode(TQuantized& voxel_value, bool& active) const
+  {
+    int32_t sum = static_cast<int32_t>(voxel_value) + logodds_miss;
+    if (sum < logodds_thres_min)
+    {
+      active = false;
+      if (sum < min_logodds)
+      {
+        sum = min_logodds;
+      }
+    }
+    voxel_value = static_cast<TQuantized>(sum);
+    return true;
+  }
+
+  bool updateOccupiedNode(TQuantized& voxel_value, bool& active) const
+  {
+    int32_t sum = static_cast<int32_t>(voxel_value) + logodds_hit;
+    if (sum > logodds_thres_max)
+    {
+      active = true;
+      if (sum > max_logodds)
+      {
+        sum = max_logodds;
+      }
+    }
+    voxel_value = static_cast<TQuantized>(sum);
+    return true;
+  }
+
+  int32_t logodds_hit;
+  int32_t logodds_miss;
+  int32_t logodds_thres_min;
+  int32_t logodds_thres_max;
+  int32_t max_logodds;
+  int32_t min_logodds;
+};
+
+/*!
+ * \brief Log-odds occupancy map storing fixed-point log-odds in a small signed integer type
+ *
+ * The clamping range of the float map is mapped onto the full value range of TQuantized, so an
+ * int8_t map resolves log-odds in steps of about 0.036 and an int16_t map in steps of about
+ * 0.00014. Hit and miss updates are rounded to whole steps of at least one, which slightly biases
+ * the occupancy estimate compared to OccupancyVDBMapping in exchange for a 4x (int8_t) or 2x
+ * (int16_t) smaller leaf buffer.
+ *
+ * \tparam TQuantized Signed integer voxel type
+ * \tparam TTreeLayout Node dimensions of the map and update trees, see TreeLayout
+ */
+template <typename TQuantized, typename TTreeLayout = DefaultTreeLayout>
+class QuantizedOccupancyVDBMappingT : public VDBMapping<TQuantized, Config, TTreeLayout>
+{
+  static_assert(std::numeric_limits<TQuantized>::is_integer &&
+                  std::numeric_limits<TQuantized>::is_signed && sizeof(TQuantized) <= 2,
+                "Quantized log-odds require a signed integer type of at most 16 bit");
+
+public:
+  using BaseT       = VDBMapping<TQuantized, Config, TTreeLayout>;
+  using UpdateGridT = typename BaseT::UpdateGridT;
+
+  QuantizedOccupancyVDBMappingT(const double resolution)
+    : BaseT(resolution)
+    , m_scale(1)
+  {
+    m_policy.logodds_hit       = 0;
+    m_policy.logodds_miss      = 0;
+    m_policy.logodds_thres_min = 0;
+    m_policy.logodds_thres_max = 0;
+    m_policy.max_logodds       = 0;
+    m_policy.min_logodds       = 0;
+  }
+
+  /*!
+   * \brief Handles changing the mapping config
+   *
+   * \param config Configuration structure
+   */
+  void setConfig(const Config& config) override;
+
+  /*!
+   * \brief Incorporates the information of an update grid to the internal map using the inlined
+   * saturating update rules
+   *
+   * \param temp_grid Grid containing all cells which shall be updated
+   *
+   * \returns Grid containing all voxels whose active state changed
+   */
+  typename UpdateGridT::Ptr updateMap(const typename UpdateGridT::Ptr& temp_grid) override;
+
+  /*!
+   * \brief Converts a stored voxel value into log-odds
+   *
+   * \param voxel_value Quantized log-odds of a voxel
+   *
+   * \returns Log-odds of the voxel
+   */
+  float logOdds(const TQuantized voxel_value) const
+  {
+    return static_cast<float>(voxel_value) / m_scale;
+  }
+
+  /*!
+   * \brief Converts log-odds into the nearest storable voxel value
+   *
+   * \param logodds Log-odds which are quantized
+   *
+   * \returns Quantized log-odds, saturated to the clamping range
+   */
+  TQuantized quantize(const double logodds) const;
+
+protected:
+  bool updateFreeNode(TQuantized& voxel_value, bool& active) override;
+  bool updateOccupiedNode(TQuantized& voxel_value, bool& active) override;
+
+  /*!
+   * \brief Quantization steps per unit of log-odds
+   */
+  float m_scale;
+  /*!
+   * \brief Update rules with all log-odds parameters in quantization steps
+   */
+  QuantizedOccupancyUpdatePolicy<TQuantized> m_policy;
+};
+
+/*!
+ * \brief Occupancy map with 8 bit log-odds and the default tree layout
+ */
+using Int8OccupancyVDBMapping = QuantizedOccupancyVDBMappingT<int8_t>;
+/*!
+ * \brief Occupancy map with 16 bit log-odds and the default tree layout
+ */
+using Int16OccupancyVDBMapping = QuantizedOccupancyVDBMappingT<int16_t>;
+
+#include "QuantizedOccupancyVDBMapping.hpp"
+
+// The default layouts are compiled into the library
+extern template class QuantizedOccupancyVDBMappingT<int8_t>;
+extern template class QuantizedOccupancyVDBMappingT<int16_t>;
+
+} // namespace vdb_mapping
+
+#endif /* VDB_MAPPING_QUANTIZED_OCCUPANCY_VDB_MAPPING_H_INCLUDED */
@@ -0,0 +1,103 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK ----------------------------------------------
+// Copyright 2021 FZI Forschungszentrum Informatik
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+// -- END LICENSE BLOCK ------------------------------------------------
+
+//----------------------------------------------------------------------
+/*!\file
+ *
+ * \author  Marvin Große Besselmann grosse@fzi.de
+ * \author  Lennart Puck puck@fzi.de
+ * \date    2021-04-29
+ *
+ */
+//----------------------------------------------------------------------
+
+
+template <typename TQuantized, typename TTreeLayout>
+bool QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::updateFreeNode(
+  TQuantized& voxel_value, bool& active)
+{
+  return m_policy.updateFreeNode(voxel_value, active);
+}
+
+template <typename TQuantized, typename TTreeLayout>
+bool QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::updateOccupiedNode(
+  TQuantized& voxel_value, bool& active)
+{
+  return m_policy.updateOccupiedNode(voxel_value, active);
+}
+
+template <typename TQuantized, typename TTreeLayout>
+typename QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::UpdateGridT::Ptr
+QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::updateMap(
+  const typename UpdateGridT::Ptr& temp_grid)
+{
+  return this->updateMapWithPolicy(temp_grid, m_policy);
+}
+
+template <typename TQuantized, typename TTreeLayout>
+TQuantized QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::quantize(
+  const double logodds) const
+{
+  const double steps = std::round(logodds * m_scale);
+  return static_cast<TQuantized>(std::max<double>(
+    m_policy.min_logodds, std::min<double>(m_policy.max_logodds, steps)));
+}
+
+template <typename TQuantized, typename TTreeLayout>
+void QuantizedOccupancyVDBMappingT<TQuantized, TTreeLayout>::setConfig(const Config& config)
+{
+  // call base class function
+  BaseT::setConfig(config);
+
+  // Sanity Check for input config
+  if (config.prob_miss > 0.5)
+  {
+    std::cerr << "Probability for a miss should be below 0.5 but is " << config.prob_miss
+              << std::endl;
+    return;
+  }
+  if (config.prob_hit < 0.5)
+  {
+    std::cerr << "Probability for a hit should be above 0.5 but is " << config.prob_hit
+              << std::endl;
+    return;
+  }
+
+  // The clamping range of the float map spans the whole value range of the voxel type
+  const double max_logodds = log(0.99) - log(0.01);
+  const int32_t max_steps  = std::numeric_limits<TQuantized>::max();
+  m_scale                  = static_cast<float>(max_steps / max_logodds);
+  m_policy.max_logodds     = max_steps;
+  m_policy.min_logodds     = -max_steps;
+
+  // Updates are rounded to whole steps, but must never vanish
+  const double logodds_hit  = log(config.prob_hit) - log(1 - config.prob_hit);
+  const double logodds_miss = log(config.prob_miss) - log(1 - config.prob_miss);
+  m_policy.logodds_hit      = std::max<int32_t>(1, quantize(logodds_hit));
+  m_policy.logodds_miss     = std::min<int32_t>(-1, quantize(logodds_miss));
+
+  // Rounded this way, the integer comparisons decide like the float comparisons of scaled values
+  const double logodds_thres_min = log(config.prob_thres_min) - log(1 - config.prob_thres_min);
+  const double logodds_thres_max = log(config.prob_thres_max) - log(1 - config.prob_thres_max);
+  const double thres_min_steps   = std::ceil(logodds_thres_min * m_scale);
+  const double thres_max_steps   = std::floor(logodds_thres_max * m_scale);
+
+  m_policy.logodds_thres_min = static_cast<int32_t>(std::max<double>(-max_steps, thres_min_steps));
+  m_policy.logodds_thres_max = static_cast<int32_t>(std::min<double>(max_steps, thres_max_steps));
+  this->m_config_set         = true;
+}
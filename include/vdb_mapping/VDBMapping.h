@@ -34,8 +34,20 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <eigen3/Eigen/Geometry>
+#include <fstream>
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <openvdb/Types.h>
 #include <openvdb/io/Stream.h>
@@ -44,6 +56,12 @@
 #include <openvdb/openvdb.h>
 #include <openvdb/tools/Clip.h>
 #include <openvdb/tools/Morphology.h>
+#include <openvdb/tools/Prune.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
 namespace vdb_mapping {
 
@@ -55,24 +73,379 @@ struct BaseConfig
 {
   double max_range;
   std::string map_directory_path;
+  /*!
+   * \brief Raycast the points of a cloud in parallel, each worker filling its own update grid
+   */
+  bool parallel_raycasting = false;
+  /*!
+   * \brief Integrate the leaf nodes of an update grid into the map in parallel
+   */
+  bool parallel_integration = false;
+  /*!
+   * \brief Cast only one ray per end voxel of a point cloud instead of one ray per point
+   */
+  bool deduplicate_endpoints = false;
+  /*!
+   * \brief Record all map updates in an append-only journal in the map directory
+   */
+  bool journaling = false;
+  /*!
+   * \brief Number of journal entries after which the journal is compacted into a checkpoint. Zero
+   * disables the automatic compaction
+   */
+  unsigned int journal_checkpoint_interval = 0;
+  /*!
+   * \brief Load maps with delayed loading, so leaf buffers are only read from the file when they
+   * are accessed
+   */
+  bool delayed_loading = false;
+  /*!
+   * \brief Maximum number of leaves of a delayed loaded map which are kept in memory. Zero
+   * disables the limit
+   */
+  std::size_t max_resident_leaves = 0;
+  /*!
+   * \brief Edge length in meters of the spatial tiles in which the map is stored around the
+   * sensor. Zero keeps the whole map in memory
+   */
+  double tile_size = 0.0;
+  /*!
+   * \brief Number of tiles kept resident around the raycasting range of the sensor. The tiles of
+   * this margin are prefetched asynchronously
+   */
+  unsigned int tile_margin = 1;
+  /*!
+   * \brief Publish an immutable snapshot of the map for concurrent readers after every update
+   */
+  bool publish_snapshots = false;
+};
+
+/*!
+ * \brief Result of an incremental pruning step, see VDBMapping::pruneMap
+ */
+struct PruneStatistics
+{
+  std::size_t visited_leaves   = 0;
+  std::size_t collapsed_leaves = 0;
+  /*!
+   * \brief Memory of the collapsed leaves which was freed
+   */
+  std::size_t reclaimed_bytes = 0;
+  /*!
+   * \brief True if the step finished a pass over all leaves of the map
+   */
+  bool complete = false;
+};
+
+/*!
+ * \brief Base class for compile-time update policies of the map integration
+ *
+ * A policy derives from this class via CRTP and implements updateFreeNode and updateOccupiedNode
+ * as non-virtual member functions, so that they can be inlined into the integration loops of
+ * VDBMapping::updateMapWithPolicy. The default updateLeaf applies these rules to all updated
+ * voxels of a leaf node and can be replaced by a policy with a batched implementation.
+ */
+template <typename TDerived>
+struct VoxelUpdatePolicy
+{
+  /*!
+   * \brief Applies the update rules to all updated voxels of a map leaf
+   *
+   * \param update_mask Mask of all voxels of the leaf which shall be updated
+   * \param hit_mask Mask of all updated voxels which are sensor hits
+   * \param leaf Map leaf which is updated
+   * \param change_mask Mask in which all voxels with a changed active state are set
+   */
+  template <typename TLeaf>
+  void updateLeaf(const typename TLeaf::NodeMaskType& update_mask,
+                  const typename TLeaf::NodeMaskType& hit_mask,
+                  TLeaf& leaf,
+                  typename TLeaf::NodeMaskType& change_mask) const
+  {
+    const TDerived& policy = static_cast<const TDerived&>(*this);
+    for (auto iter = update_mask.beginOn(); iter; ++iter)
+    {
+      const openvdb::Index offset           = iter.pos();
+      typename TLeaf::ValueType voxel_value = leaf.getValue(offset);
+      bool active                           = leaf.isValueOn(offset);
+      const bool last_state                 = active;
+      if (hit_mask.isOn(offset))
+      {
+        policy.updateOccupiedNode(voxel_value, active);
+      }
+      else
+      {
+        policy.updateFreeNode(voxel_value, active);
+      }
+      leaf.setValueOnly(offset, voxel_value);
+      leaf.setActiveState(offset, active);
+      change_mask.set(offset, last_state != active);
+    }
+  }
+};
+
+/*!
+ * \brief Non-owning view of the point coordinates of a sensor buffer
+ *
+ * Every point starts with its x, y and z coordinate as consecutive floats and consecutive points
+ * are a fixed number of bytes apart. This matches interleaved driver buffers as well as PCL clouds
+ * of all point types with a leading xyz field, so their points can be raycast without a copy. The
+ * viewed buffer has to outlive the span.
+ *
+ * A span of sensor frame points can carry the sensor pose, in which case each point is transformed
+ * when it is accessed instead of transforming the whole buffer beforehand.
+ */
+class PointSpan
+{
+public:
+  /*!
+   * \brief Views a raw point buffer
+   *
+   * \param data Pointer to the x coordinate of the first point
+   * \param size Number of points
+   * \param stride Distance between two consecutive points in bytes
+   */
+  PointSpan(const float* data, const std::size_t size, const std::size_t stride = 3 * sizeof(float))
+    : m_data(reinterpret_cast<const unsigned char*>(data))
+    , m_size(size)
+    , m_stride(stride)
+    , m_transformed(false)
+    , m_rotation(Eigen::Matrix<double, 3, 3>::Identity())
+    , m_translation(Eigen::Matrix<double, 3, 1>::Zero())
+  {
+  }
+
+  /*!
+   * \brief Views the points of a PCL cloud of an arbitrary xyz point type
+   *
+   * \param cloud Point cloud
+   */
+  template <typename TPoint>
+  PointSpan(const pcl::PointCloud<TPoint>& cloud)
+    : PointSpan(cloud.empty() ? nullptr : cloud.points.front().data, cloud.size(), sizeof(TPoint))
+  {
+  }
+
+  std::size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  /*!
+   * \brief Returns a view of the same points which transforms them on access
+   *
+   * \param tf Transform from the frame of the points to the target frame
+   *
+   * \returns Span of the points in the target frame
+   */
+  PointSpan transformed(const Eigen::Isometry3d& tf) const
+  {
+    PointSpan span = *this;
+    if (m_transformed)
+    {
+      span.m_translation = tf.linear() * m_translation + tf.translation();
+      span.m_rotation    = tf.linear() * m_rotation;
+    }
+    else
+    {
+      span.m_translation = tf.translation();
+      span.m_rotation    = tf.linear();
+    }
+    span.m_transformed = true;
+    return span;
+  }
+
+  /*!
+   * \brief Returns the coordinates of a point
+   *
+   * \param i Index of the point
+   */
+  openvdb::Vec3d operator[](const std::size_t i) const
+  {
+    const float* point = reinterpret_cast<const float*>(m_data + i * m_stride);
+    if (!m_transformed)
+    {
+      return openvdb::Vec3d(point[0], point[1], point[2]);
+    }
+    const Eigen::Matrix<double, 3, 1> transformed =
+      m_rotation * Eigen::Matrix<double, 3, 1>(point[0], point[1], point[2]) + m_translation;
+    return openvdb::Vec3d(transformed.x(), transformed.y(), transformed.z());
+  }
+
+private:
+  const unsigned char* m_data;
+  std::size_t m_size;
+  std::size_t m_stride;
+  bool m_transformed;
+  Eigen::Matrix<double, 3, 3> m_rotation;
+  Eigen::Matrix<double, 3, 1> m_translation;
+};
+
+/*!
+ * \brief Hierarchical DDA which finds the first active voxel or tile of a tree along a ray
+ *
+ * Follows the structure of openvdb::math::VolumeHDDA. On each tree level a DDA steps through the
+ * nodes of that level and only descends into existing child nodes, so empty space is skipped at
+ * the coarsest possible level. Level -1 denotes the voxel level.
+ *
+ * @tparam TTree Tree type which is traversed
+ * @tparam TRay Ray type in index space
+ * @tparam TChildNodeLevel Level of the nodes the DDA of this instance steps through
+ */
+template <typename TTree, typename TRay, int TChildNodeLevel>
+class OccupancyHDDA
+{
+public:
+  using ChainT = typename TTree::RootNodeType::NodeChainType;
+  using NodeT  = typename ChainT::template Get<TChildNodeLevel>;
+  using DDAT   = openvdb::math::DDA<TRay, NodeT::TOTAL>;
+
+  /*!
+   * \brief Marches along a ray until the first active voxel or tile
+   *
+   * \param ray Ray in index space, limited by its time interval. The times are modified
+   * \param acc Accessor to the tree
+   * \param hit Voxel which was hit
+   * \param time Ray time at which the hit voxel is entered
+   *
+   * \returns True if an active voxel or tile was hit within the time interval of the ray
+   */
+  template <typename TAccessor>
+  bool march(TRay& ray, const TAccessor& acc, openvdb::Coord& hit, double& time)
+  {
+    m_dda.init(ray);
+    do
+    {
+      if (acc.template probeConstNode<NodeT>(m_dda.voxel()) != nullptr)
+      {
+        ray.setTimes(m_dda.time(), m_dda.next());
+        if (m_child_hdda.march(ray, acc, hit, time))
+        {
+          return true;
+        }
+      }
+      else if (acc.isValueOn(m_dda.voxel()))
+      {
+        // Active tile, the hit is the voxel of the tile in which the ray enters it
+        time                         = m_dda.time();
+        const openvdb::Coord entry   = openvdb::Coord::floor(ray(time));
+        const openvdb::Coord& origin = m_dda.voxel();
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          hit[axis] = std::min(std::max(entry[axis], origin[axis]),
+                               origin[axis] + static_cast<openvdb::Int32>(NodeT::DIM) - 1);
+        }
+        return true;
+      }
+    } while (m_dda.step());
+    return false;
+  }
+
+private:
+  DDAT m_dda;
+  OccupancyHDDA<TTree, TRay, TChildNodeLevel - 1> m_child_hdda;
+};
+
+/*!
+ * \brief Voxel level of the hierarchical DDA
+ */
+template <typename TTree, typename TRay>
+class OccupancyHDDA<TTree, TRay, -1>
+{
+public:
+  using DDAT = openvdb::math::DDA<TRay, 0>;
+
+  template <typename TAccessor>
+  bool march(TRay& ray, const TAccessor& acc, openvdb::Coord& hit, double& time)
+  {
+    m_dda.init(ray);
+    do
+    {
+      if (acc.isValueOn(m_dda.voxel()))
+      {
+        hit  = m_dda.voxel();
+        time = m_dda.time();
+        return true;
+      }
+    } while (m_dda.step());
+    return false;
+  }
+
+private:
+  DDAT m_dda;
+};
+
+/*!
+ * \brief Node dimensions of the map and update trees
+ *
+ * Both trees consist of a root node, two internal node levels and leaf nodes. The log2 dimensions
+ * of the internal nodes can be chosen per tree, e.g. larger nodes for sparse long range maps to
+ * reduce root table lookups or smaller nodes for dense indoor maps to reduce the memory per node.
+ * The leaf dimension of 8^3 voxels is shared by both trees, since map and update leaves are
+ * combined word by word in the leaf based integration.
+ */
+template <openvdb::Index TMapUpperLog2,
+          openvdb::Index TMapLowerLog2,
+          openvdb::Index TUpdateUpperLog2,
+          openvdb::Index TUpdateLowerLog2>
+struct TreeLayout
+{
+  static constexpr openvdb::Index LEAF_LOG2 = 3;
+
+  template <typename TData>
+  using MapTreeT =
+    typename openvdb::tree::Tree4<TData, TMapUpperLog2, TMapLowerLog2, LEAF_LOG2>::Type;
+  using UpdateTreeT =
+    typename openvdb::tree::Tree4<bool, TUpdateUpperLog2, TUpdateLowerLog2, LEAF_LOG2>::Type;
 };
+
+/*!
+ * \brief Layout of the standard OpenVDB trees, suited for most scenes
+ */
+using DefaultTreeLayout = TreeLayout<5, 4, 1, 4>;
+/*!
+ * \brief Larger internal nodes for sparse maps of long range sensors
+ */
+using LongRangeTreeLayout = TreeLayout<6, 5, 4, 5>;
+/*!
+ * \brief Smaller internal nodes for dense maps of confined indoor spaces
+ */
+using IndoorTreeLayout = TreeLayout<4, 3, 1, 3>;
+
 /*!
  * \brief Main Mapping class which handles all data integration
  */
-template <typename TData, typename TConfig = BaseConfig>
+template <typename TData, typename TConfig = BaseConfig, typename TTreeLayout = DefaultTreeLayout>
 class VDBMapping
 {
 public:
   using PointT      = pcl::PointXYZ;
   using PointCloudT = pcl::PointCloud<PointT>;
 
+  using TransformVectorT = std::vector<Eigen::Matrix<double, 4, 4>,
+                                       Eigen::aligned_allocator<Eigen::Matrix<double, 4, 4> > >;
+
   using RayT  = openvdb::math::Ray<double>;
   using Vec3T = RayT::Vec3Type;
   using DDAT  = openvdb::math::DDA<RayT, 0>;
 
-  using GridT       = openvdb::Grid<typename openvdb::tree::Tree4<TData, 5, 4, 3>::Type>;
-  using UpdateGridT = openvdb::Grid<openvdb::tree::Tree4<bool, 1, 4, 3>::Type>;
+  using GridT       = openvdb::Grid<typename TTreeLayout::template MapTreeT<TData> >;
+  using UpdateGridT = openvdb::Grid<typename TTreeLayout::UpdateTreeT>;
+
+  using HDDAT = OccupancyHDDA<typename GridT::TreeType,
+                              RayT,
+                              GridT::TreeType::RootNodeType::ChildNodeType::LEVEL>;
 
+  /*!
+   * \brief Measurement of a single sensor within a multi-sensor batch
+   */
+  struct SensorMeasurement
+  {
+    PointCloudT::ConstPtr cloud;
+    Eigen::Matrix<double, 3, 1> origin;
+    /*!
+     * \brief Maximum raycasting range, the configured range is used if not positive
+     */
+    double max_range;
+  };
 
   VDBMapping()                  = delete;
   VDBMapping(const VDBMapping&) = delete;
@@ -105,11 +478,93 @@ public:
    */
   bool saveMap() const;
 
+  /*!
+   * \brief Saves the current map on a background thread
+   *
+   * A snapshot of the map is taken on the calling thread, so the map can be modified while the
+   * snapshot is serialized. The map is written to a temporary file which is renamed into the map
+   * directory once it is complete. The returned future has to be kept until the save finished, as
+   * destroying it blocks until then.
+   *
+   * \returns Future holding whether the map was saved successfully
+   */
+  std::future<bool> saveMapAsync() const;
+
   /*!
    * \brief Loads a stored map
+   *
+   * If delayed loading is enabled, only the tree topology is read. The voxel values of a leaf are
+   * paged in from the file the first time the leaf is accessed, so the loading time does not
+   * depend on the size of the map. The file must not be removed while the map is in use.
    */
   bool loadMap(const std::string& file_path);
 
+  /*!
+   * \brief Counts the leaves of the map whose voxel values are held in memory
+   *
+   * \returns Number of resident leaves
+   */
+  std::size_t residentLeafCount() const;
+
+  /*!
+   * \brief Pages out resident leaves of a delayed loaded map until at most the configured maximum
+   * are resident
+   *
+   * Each evicted leaf is replaced by its out of core counterpart from the map file, which is kept
+   * open since loading the map, so it is paged in again on its next access. Leaves which were
+   * modified since the map was loaded differ from the file and stay resident. Should be called
+   * periodically, e.g. after a batch of queries.
+   *
+   * \returns False if the modified leaves alone exceed the limit
+   */
+  bool enforceResidentLeafLimit();
+
+  /*!
+   * \brief Collapses uniform leaves of the map into tiles until a time budget is used up
+   *
+   * Leaves whose voxels share one value and one active state, e.g. saturated free space, are
+   * replaced by a tile of that value, which keeps all map queries unchanged. Each call continues
+   * the pass of the previous one after the leaf it visited last and visits at least one leaf, so
+   * the pruning can be spread over the idle time between scans. Finding the next leaf only
+   * descends the tree, so no call walks all leaves of the map. A new pass starts once a pass
+   * completed. Leaves of a delayed loaded map which are not resident are skipped.
+   *
+   * \param budget Time after which no further leaf is visited
+   *
+   * \returns Visited and collapsed leaves and the reclaimed memory of this call
+   */
+  PruneStatistics pruneMap(const std::chrono::microseconds& budget);
+
+  /*!
+   * \brief Compacts the journal into a full checkpoint of the map
+   *
+   * The checkpoint is written to the map directory and records the generation of the journal
+   * which is continued afterwards. Journals of older generations are removed once the checkpoint
+   * is complete.
+   *
+   * \returns True if the checkpoint was written successfully
+   */
+  bool checkpointMap();
+
+  /*!
+   * \brief Loads the checkpoint of the map directory and replays all journals recorded after it
+   *
+   * The map has to be configured like the one which recorded the journal, since the journaled
+   * update grids are integrated with the current update rules. Overwrites and applied map sections
+   * are replayed as they were recorded. If journaling is enabled, a new
+   * checkpoint is written afterwards and the journal is continued.
+   *
+   * \returns True if the map was restored successfully
+   */
+  bool loadJournaledMap();
+
+
+  /*!
+   * \brief Writes all resident tiles of a tiled map to the map directory without evicting them
+   *
+   * \returns True if all tiles were written successfully
+   */
+  bool storeResidentTiles();
 
   /*!
    * \brief Accumulates a new sensor point cloud to the update grid
@@ -122,16 +577,54 @@ public:
                         const Eigen::Matrix<double, 3, 1>& origin,
                         const double& max_range);
 
+  /*!
+   * \brief Accumulates the points of a sensor buffer to the update grid without copying them
+   *
+   * \param points Input points in map coordinates
+   * \param origin Sensor position in map coordinates
+   * \param max_range Maximum raycasting range of this measurement
+   */
+  void accumulateUpdate(const PointSpan& points,
+                        const Eigen::Matrix<double, 3, 1>& origin,
+                        const double& max_range);
+
+  /*!
+   * \brief Accumulates the measurements of several sensors in parallel
+   *
+   * Each sensor is raycast into its own update grid. The grids are merged with hits taking
+   * priority over misses, which yields the same update as accumulating the measurements one after
+   * another.
+   *
+   * \param measurements Measurements of all sensors of one cycle
+   */
+  void accumulateUpdates(const std::vector<SensorMeasurement>& measurements);
+
   /*!
    * \brief Integrates the accumulated updates into the map
    *
    * \param update_grid Update grid
    * \param overwrite_grid Overwrite grid
    */
-  void integrateUpdate(UpdateGridT::Ptr& update_grid, UpdateGridT::Ptr& overwrite_grid);
+  void integrateUpdate(typename UpdateGridT::Ptr& update_grid,
+                       typename UpdateGridT::Ptr& overwrite_grid);
+
+  /*!
+   * \brief Integrates an externally accumulated update grid into the map
+   *
+   * Unlike accumulateUpdate, this does not move the resident tile window, so tiled maps should
+   * keep using insertPointCloud.
+   *
+   * \param update_grid Update grid, e.g. filled by raycastPointCloud
+   *
+   * \returns Overwrite grid containing all changed voxel indices
+   */
+  typename UpdateGridT::Ptr integrateUpdate(const typename UpdateGridT::Ptr& update_grid);
 
   /*!
    * \brief Resets the updates grid
+   *
+   * If the previous update grid is no longer referenced outside of the map, its nodes are kept
+   * and reused by the next update.
    */
   void resetUpdate();
 
@@ -160,8 +653,110 @@ public:
    */
   bool insertPointCloud(const PointCloudT::ConstPtr& cloud,
                         const Eigen::Matrix<double, 3, 1>& origin,
-                        UpdateGridT::Ptr& update_grid,
-                        UpdateGridT::Ptr& overwrite_grid);
+                        typename UpdateGridT::Ptr& update_grid,
+                        typename UpdateGridT::Ptr& overwrite_grid);
+
+  /*!
+   * \brief Integrates the points of a sensor buffer or a cloud of any xyz point type without
+   * copying them
+   *
+   * \param points Input points in map coordinates
+   * \param origin Sensor position in map coordinates
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points, const Eigen::Matrix<double, 3, 1>& origin);
+
+  /*!
+   * \brief Integrates the points of a sensor buffer or a cloud of any xyz point type without
+   * copying them
+   *
+   * \param points Input points in map coordinates
+   * \param origin Sensor position in map coordinates
+   * \param update_grid Update grid that was created internally while mapping
+   * \param overwrite_grid Overwrite grid containing all changed voxel indices
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points,
+                        const Eigen::Matrix<double, 3, 1>& origin,
+                        typename UpdateGridT::Ptr& update_grid,
+                        typename UpdateGridT::Ptr& overwrite_grid);
+
+  /*!
+   * \brief Integrates sensor frame points, transforming each point into the map frame while it is
+   * raycast. The sensor origin is the translation of the pose.
+   *
+   * \param points Input points in sensor coordinates
+   * \param sensor_to_map_tf Pose of the sensor in the map frame
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points, const Eigen::Isometry3d& sensor_to_map_tf);
+
+  /*!
+   * \brief Integrates sensor frame points, transforming each point into the map frame while it is
+   * raycast. The sensor origin is the translation of the pose.
+   *
+   * \param points Input points in sensor coordinates
+   * \param sensor_to_map_tf Pose of the sensor in the map frame
+   * \param update_grid Update grid that was created internally while mapping
+   * \param overwrite_grid Overwrite grid containing all changed voxel indices
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points,
+                        const Eigen::Isometry3d& sensor_to_map_tf,
+                        typename UpdateGridT::Ptr& update_grid,
+                        typename UpdateGridT::Ptr& overwrite_grid);
+
+  /*!
+   * \brief Integrates sensor frame points given a homogeneous rigid sensor pose
+   *
+   * \param points Input points in sensor coordinates
+   * \param sensor_to_map_tf Pose of the sensor in the map frame
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points,
+                        const Eigen::Matrix<double, 4, 4>& sensor_to_map_tf);
+
+  /*!
+   * \brief Integrates sensor frame points given a homogeneous rigid sensor pose
+   *
+   * \param points Input points in sensor coordinates
+   * \param sensor_to_map_tf Pose of the sensor in the map frame
+   * \param update_grid Update grid that was created internally while mapping
+   * \param overwrite_grid Overwrite grid containing all changed voxel indices
+   *
+   * \returns Was the insertion of the new points successful
+   */
+  bool insertPointCloud(const PointSpan& points,
+                        const Eigen::Matrix<double, 4, 4>& sensor_to_map_tf,
+                        typename UpdateGridT::Ptr& update_grid,
+                        typename UpdateGridT::Ptr& overwrite_grid);
+
+  /*!
+   * \brief Integrates the measurements of several sensors with a single map update
+   *
+   * \param measurements Measurements of all sensors of one cycle
+   *
+   * \returns Was the insertion of the new pointclouds successful
+   */
+  bool insertPointClouds(const std::vector<SensorMeasurement>& measurements);
+
+  /*!
+   * \brief Integrates the measurements of several sensors with a single map update
+   *
+   * \param measurements Measurements of all sensors of one cycle
+   * \param update_grid Update grid that was created internally while mapping
+   * \param overwrite_grid Overwrite grid containing all changed voxel indices
+   *
+   * \returns Was the insertion of the new pointclouds successful
+   */
+  bool insertPointClouds(const std::vector<SensorMeasurement>& measurements,
+                         typename UpdateGridT::Ptr& update_grid,
+                         typename UpdateGridT::Ptr& overwrite_grid);
 
   /*!
    * \brief  Raycasts a Pointcloud into an update Grid
@@ -181,7 +776,7 @@ public:
    */
   bool raycastPointCloud(const PointCloudT::ConstPtr& cloud,
                          const Eigen::Matrix<double, 3, 1>& origin,
-                         UpdateGridT::Accessor& update_grid_acc);
+                         typename UpdateGridT::Accessor& update_grid_acc);
 
   /*!
    * \brief  Raycasts a Pointcloud into an update Grid
@@ -202,7 +797,53 @@ public:
   bool raycastPointCloud(const PointCloudT::ConstPtr& cloud,
                          const Eigen::Matrix<double, 3, 1>& origin,
                          const double raycast_range,
-                         UpdateGridT::Accessor& update_grid_acc);
+                         typename UpdateGridT::Accessor& update_grid_acc);
+
+  /*!
+   * \brief Raycasts the points of a sensor buffer or a cloud of any xyz point type into an update
+   * grid, reading the coordinates directly from the buffer
+   *
+   * \param points Input sensor points
+   * \param origin Origin of the sensor measurement
+   * \param update_grid_acc Accessor to the grid in which the raycasting takes place
+   *
+   * \returns Raycasted update grid
+   */
+  bool raycastPointCloud(const PointSpan& points,
+                         const Eigen::Matrix<double, 3, 1>& origin,
+                         typename UpdateGridT::Accessor& update_grid_acc);
+
+  /*!
+   * \brief Raycasts the points of a sensor buffer or a cloud of any xyz point type into an update
+   * grid, reading the coordinates directly from the buffer
+   *
+   * \param points Input sensor points
+   * \param origin Origin of the sensor measurement
+   * \param raycast_range Maximum raycasting range
+   * \param update_grid_acc Accessor to the grid in which the raycasting takes place
+   *
+   * \returns Raycasted update grid
+   */
+  bool raycastPointCloud(const PointSpan& points,
+                         const Eigen::Matrix<double, 3, 1>& origin,
+                         const double raycast_range,
+                         typename UpdateGridT::Accessor& update_grid_acc);
+
+  /*!
+   * \brief Raycasts sensor frame points into an update grid, transforming each point into the map
+   * frame while it is raycast
+   *
+   * \param points Input points in sensor coordinates
+   * \param sensor_to_map_tf Pose of the sensor in the map frame
+   * \param raycast_range Maximum raycasting range
+   * \param update_grid_acc Accessor to the grid in which the raycasting takes place
+   *
+   * \returns Raycasted update grid
+   */
+  bool raycastPointCloud(const PointSpan& points,
+                         const Eigen::Isometry3d& sensor_to_map_tf,
+                         const double raycast_range,
+                         typename UpdateGridT::Accessor& update_grid_acc);
 
   /*!
    * \brief Casts a single ray into an update grid structure
@@ -219,40 +860,129 @@ public:
   openvdb::Coord castRayIntoGrid(const openvdb::Vec3d& ray_origin_world,
                                  const Vec3T& ray_origin_index,
                                  const openvdb::Vec3d& ray_end_world,
-                                 UpdateGridT::Accessor& update_grid_acc) const;
+                                 typename UpdateGridT::Accessor& update_grid_acc) const;
 
-  bool raytrace(const openvdb::Vec3d& ray_origin_world,
-                const openvdb::Vec3d& ray_direction,
-                const double max_ray_length,
-                openvdb::Vec3d& end_point);
+  /*!
+   * \brief Direction of a ray rounded to -1, 0 or 1 per axis. Components within one voxel size
+   * are rounded to 0.
+   */
+  openvdb::Vec3d raySign(const openvdb::Vec3d& ray_origin_world,
+                         const openvdb::Vec3d& ray_end_world) const;
 
   /*!
-   * \brief Overwrites the active states of a map given an update grid
+   * \brief Computes the end voxel which raycastPoint marks as hit for a ray, without casting it
    *
-   * \param update_grid Update Grid containing all states that changed during the last update
+   * \param ray_origin_world Ray origin in world coordinates
+   * \param ray_end_world Ray endpoint in world coordinates, already clipped to the raycasting range
+   *
+   * \returns Index coordinate of the end voxel
    */
-  void overwriteMap(const UpdateGridT::Ptr& update_grid);
+  openvdb::Coord rayEndIndex(const openvdb::Vec3d& ray_origin_world,
+                             const openvdb::Vec3d& ray_end_world) const;
 
   /*!
-   * \brief Incorporates the information of an update grid to the internal map. This will update the
-   * probabilities of all cells specified by the update grid.
+   * \brief Merges the content of an update grid into another update grid
    *
-   * \param temp_grid Grid containing all cells which shall be updated
+   * Active voxels of the source grid are activated in the target grid. A voxel marked as a hit in
+   * either grid remains a hit, so the merge yields the same grid as raycasting both measurements
+   * into a single update grid. The grids are combined leaf by leaf on whole mask words.
    *
-   * \returns Was the insertion of the pointcloud successuff
+   * \param source Update grid which is merged
+   * \param target_acc Accessor to the update grid which receives the merged data
    */
-  UpdateGridT::Ptr updateMap(const UpdateGridT::Ptr& temp_grid);
+  void mergeUpdateGrid(const UpdateGridT& source, typename UpdateGridT::Accessor& target_acc) const;
 
   /*!
-   * \brief Returns a pointer to the VDB map structure
+   * \brief Casts a ray into the map and returns the first active voxel along it
    *
-   * \returns Map pointer
+   * The ray is traversed with a hierarchical DDA, which skips empty internal and leaf nodes of the
+   * map without visiting their voxels.
+   *
+   * \param ray_origin_world Origin of the ray in world coordinates
+   * \param ray_direction Direction of the ray
+   * \param max_ray_length Maximum length of the ray in meters
+   * \param end_point Position of the hit voxel in world coordinates
+   *
+   * \returns True if an active voxel was hit within the maximum ray length
+   */
+  bool raytrace(const openvdb::Vec3d& ray_origin_world,
+                const openvdb::Vec3d& ray_direction,
+                const double max_ray_length,
+                openvdb::Vec3d& end_point) const;
+
+  /*!
+   * \brief Casts a batch of rays into the map in parallel
+   *
+   * Each worker thread traces its rays with its own cached accessor. All arrays have to hold
+   * ray_count elements. Entries of end_points and distances are only written for rays which hit.
+   *
+   * \param ray_origins_world Origins of the rays in world coordinates
+   * \param ray_directions Directions of the rays
+   * \param ray_count Number of rays
+   * \param max_ray_length Maximum length of the rays in meters
+   * \param end_points Positions of the hit voxels in world coordinates
+   * \param distances Distances along the rays to the hit voxels in meters
+   * \param hits Flags whether the rays hit an active voxel within the maximum ray length
+   */
+  void raytraceBatch(const openvdb::Vec3d* ray_origins_world,
+                     const openvdb::Vec3d* ray_directions,
+                     const std::size_t ray_count,
+                     const double max_ray_length,
+                     openvdb::Vec3d* end_points,
+                     double* distances,
+                     bool* hits) const;
+
+  /*!
+   * \brief Overwrites the active states of a map given an update grid
+   *
+   * \param update_grid Update Grid containing all states that changed during the last update
+   */
+  void overwriteMap(const typename UpdateGridT::Ptr& update_grid);
+
+  /*!
+   * \brief Incorporates the information of an update grid to the internal map. This will update the
+   * probabilities of all cells specified by the update grid.
+   *
+   * \param temp_grid Grid containing all cells which shall be updated
+   *
+   * \returns Was the insertion of the pointcloud successuff
+   */
+  virtual typename UpdateGridT::Ptr updateMap(const typename UpdateGridT::Ptr& temp_grid);
+
+  /*!
+   * \brief Returns a pointer to the VDB map structure
+   *
+   * \returns Map pointer
    */
   typename GridT::Ptr getGrid() const { return m_vdb_grid; }
 
+  /*!
+   * \brief Returns the most recently published snapshot of the map
+   *
+   * The snapshot is never modified, so it can be read from any thread without locking while the
+   * map is updated. Holding a snapshot for a long time delays the publication of new snapshots
+   * but never blocks the mapping. Requires publish_snapshots to be enabled.
+   *
+   * \returns Snapshot of the map, null if no snapshot was published yet
+   */
+  typename GridT::ConstPtr getGridSnapshot() const { return std::atomic_load(&m_snapshot); }
+
+  /*!
+   * \brief Publishes the current state of the map as snapshot for concurrent readers
+   *
+   * Two snapshot buffers are used alternately. The back buffer is brought up to date by copying
+   * only the leaves changed since it was published last, unless it is still held by a reader. In
+   * that case the publication is deferred to the next call.
+   *
+   * \returns True if a new snapshot was published
+   */
+  bool publishSnapshot();
+
   /*!
    * \brief Creates a world coordinate bounding box around a transform
    *
+   * The eight box corners are transformed directly, so no memory is allocated.
+   *
    * \param min_boundary Minimum boundary of box
    * \param max_boundary Maximum boundary of box
    * \param map_to_reference_tf Transform from map to reference frame
@@ -277,6 +1007,22 @@ public:
                          const Eigen::Matrix<double, 3, 1>& max_boundary,
                          const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const;
 
+  /*!
+   * \brief Creates the index coordinate bounding boxes of a box around several transforms
+   *
+   * Allocates memory only if the output vector has to grow, so a reused vector makes the call
+   * allocation free.
+   *
+   * \param min_boundary Minimum boundary of the box
+   * \param max_boundary Maximum boundary of the box
+   * \param map_to_reference_tfs Transforms from map to reference frame
+   * \param bounding_boxes Index coordinate bounding box per transform
+   */
+  void createIndexBoundingBoxes(const Eigen::Matrix<double, 3, 1>& min_boundary,
+                                const Eigen::Matrix<double, 3, 1>& max_boundary,
+                                const TransformVectorT& map_to_reference_tfs,
+                                std::vector<openvdb::CoordBBox>& bounding_boxes) const;
+
   /*!
    * \brief Generates an update grid from a bouding box and a reference frame
    *
@@ -296,20 +1042,28 @@ public:
    * \param min_boundary Minimum boundary of the box
    * \param max_boundary Maximum boundary of the box
    * \param map_to_reference_tf Transform from map to reference frame
+   * \param copy_values Carry the voxel values of the map instead of only the active states
    *
    * \returns Grid containing the information within the bounding box
    */
   typename GridT::Ptr
   getMapSectionGrid(const Eigen::Matrix<double, 3, 1>& min_boundary,
                     const Eigen::Matrix<double, 3, 1>& max_boundary,
-                    const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const;
+                    const Eigen::Matrix<double, 4, 4>& map_to_reference_tf,
+                    const bool copy_values = false) const;
   /*!
    * \brief Generates a grid or update grid from a bounding box and a reference frame
    *
+   * Only the tree nodes overlapping the bounding box are visited. Leaf nodes and tiles which are
+   * fully contained in the box are copied as a whole, so the cost scales with the size of the
+   * section instead of the size of the map.
+   *
    * @tparam TResultGrid Resulting Grid Type
    * \param min_boundary Minimum boundary of the box
    * \param max_boundary Maximum boundary of the box
    * \param map_to_reference_tf Transform from map to reference frame
+   * \param copy_values Carry the voxel values of the map instead of only the active states. Only
+   * takes effect if the value type of the resulting grid matches the map
    *
    * \returns Grid/UpdateGrid containing the information within the bounding box
    */
@@ -317,7 +1071,8 @@ public:
   typename TResultGrid::Ptr
   getMapSection(const Eigen::Matrix<double, 3, 1>& min_boundary,
                 const Eigen::Matrix<double, 3, 1>& max_boundary,
-                const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const;
+                const Eigen::Matrix<double, 4, 4>& map_to_reference_tf,
+                const bool copy_values = false) const;
 
   /*!
    * \brief Applies a map section grid to the map
@@ -326,7 +1081,7 @@ public:
    * of the section is encoded in the grids meta information
    *
    */
-  void applyMapSectionGrid(const typename VDBMapping<TData, TConfig>::GridT::Ptr section);
+  void applyMapSectionGrid(const typename GridT::Ptr section);
 
   /*!
    * \brief Applies a map section update grid to the map
@@ -335,12 +1090,18 @@ public:
    * of the section is encoded in the grids meta information
    *
    */
-  void
-  applyMapSectionUpdateGrid(const typename VDBMapping<TData, TConfig>::UpdateGridT::Ptr section);
+  void applyMapSectionUpdateGrid(const typename UpdateGridT::Ptr section);
 
   /*!
    * \brief Applies a map section to the map
    *
+   * The bounding box region of the map is deactivated at node level before the leaves and tiles of
+   * the section are grafted into the map, so the cost scales with the size of the section. If the
+   * section carries values (see getMapSection), the region is reset to the background value
+   * instead, so afterwards it matches the section exactly, including voxels the section holds no
+   * leaf or tile for. Leaves fully inside the bounding box replace the leaves of the map as a
+   * whole.
+   *
    * \param section Section grid containing the information about part of the map. The boundary box
    * of the section is encoded in the grids meta information
    *
@@ -357,6 +1118,490 @@ public:
 
 
 protected:
+  /*!
+   * \brief Update policy forwarding to the virtual update functions of a mapping object
+   */
+  struct VirtualUpdatePolicy : VoxelUpdatePolicy<VirtualUpdatePolicy>
+  {
+    explicit VirtualUpdatePolicy(VDBMapping* mapping)
+      : mapping(mapping)
+    {
+    }
+    bool updateFreeNode(TData& voxel_value, bool& active) const
+    {
+      return mapping->updateFreeNode(voxel_value, active);
+    }
+    bool updateOccupiedNode(TData& voxel_value, bool& active) const
+    {
+      return mapping->updateOccupiedNode(voxel_value, active);
+    }
+    VDBMapping* mapping;
+  };
+
+  /*!
+   * \brief Incorporates the information of an update grid into the map using the update rules of
+   * a compile-time policy
+   *
+   * \param temp_grid Grid containing all cells which shall be updated
+   * \param policy Update policy deriving from VoxelUpdatePolicy
+   *
+   * \returns Grid containing all voxels whose active state changed
+   */
+  template <typename TUpdatePolicy>
+  typename UpdateGridT::Ptr updateMapWithPolicy(const typename UpdateGridT::Ptr& temp_grid,
+                                                const TUpdatePolicy& policy);
+
+  /*!
+   * \brief Incorporates the information of an update grid into the map by processing its leaf
+   * nodes in parallel.
+   *
+   * The leaf topology of all updated voxels is created in the map beforehand, so the workers only
+   * modify existing leaf nodes. The state changes of each leaf are collected as masks and written
+   * into the recycled change grid afterwards. The update grid must not contain active tiles.
+   *
+   * \param temp_grid Grid containing all cells which shall be updated
+   * \param policy Update policy deriving from VoxelUpdatePolicy
+   *
+   * \returns Grid containing all voxels whose active state changed
+   */
+  template <typename TUpdatePolicy>
+  typename UpdateGridT::Ptr updateMapParallel(const typename UpdateGridT::Ptr& temp_grid,
+                                              const TUpdatePolicy& policy);
+
+  /*!
+   * \brief Extracts the mask of all sensor hits of an update grid leaf
+   *
+   * \param update_leaf Leaf of an update grid
+   *
+   * \returns Mask of all active voxels which are marked as hits
+   */
+  typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType
+  hitMask(const typename UpdateGridT::TreeType::LeafNodeType& update_leaf) const;
+
+  /*!
+   * \brief Overwrites the active voxels and hit values of an update grid leaf
+   *
+   * Both are stored as bit masks in a boolean leaf, so the leaf is written word by word.
+   *
+   * \param update_leaf Leaf of an update grid
+   * \param update_mask Mask of all active voxels
+   * \param hit_mask Mask of all active voxels which are marked as hits
+   */
+  static void
+  setUpdateLeaf(typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+                const typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& update_mask,
+                const typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& hit_mask);
+
+  /*!
+   * \brief Applies all updates of an update grid leaf to the corresponding map leaf
+   *
+   * \param update_leaf Leaf of the update grid
+   * \param leaf Map leaf at the same origin
+   * \param policy Update policy deriving from VoxelUpdatePolicy
+   * \param change_acc Accessor to the grid which receives all voxels whose active state changed
+   */
+  template <typename TUpdatePolicy>
+  void integrateUpdateLeaf(const typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+                           typename GridT::TreeType::LeafNodeType& leaf,
+                           const TUpdatePolicy& policy,
+                           typename UpdateGridT::Accessor& change_acc) const;
+
+  /*!
+   * \brief Applies all updates of an update grid leaf to the corresponding map leaf without
+   * touching any grid but the map
+   *
+   * \param update_leaf Leaf of the update grid
+   * \param leaf Map leaf at the same origin
+   * \param policy Update policy deriving from VoxelUpdatePolicy
+   * \param change_mask Mask in which all voxels with a changed active state are set
+   * \param change_hit_mask Mask in which all changed voxels are set which are sensor hits
+   */
+  template <typename TUpdatePolicy>
+  void integrateUpdateLeaf(
+    const typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+    typename GridT::TreeType::LeafNodeType& leaf,
+    const TUpdatePolicy& policy,
+    typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& change_mask,
+    typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& change_hit_mask) const;
+
+  /*!
+   * \brief Raycasts a single sensor point into an update grid
+   *
+   * \param ray_origin_world Ray origin in world coordinates
+   * \param ray_origin_index Ray origin in index coordinates
+   * \param ray_end_world Measured point in world coordinates
+   * \param raycast_range Maximum raycasting range
+   * \param update_grid_acc Accessor to the update grid
+   */
+  void raycastPoint(const openvdb::Vec3d& ray_origin_world,
+                    const Vec3T& ray_origin_index,
+                    openvdb::Vec3d ray_end_world,
+                    const double raycast_range,
+                    typename UpdateGridT::Accessor& update_grid_acc) const;
+
+  /*!
+   * \brief Casts a single ray into the map using a given accessor
+   *
+   * \param acc Accessor to the map
+   * \param ray_origin_world Origin of the ray in world coordinates
+   * \param ray_direction Direction of the ray
+   * \param max_ray_length Maximum length of the ray in meters
+   * \param end_point Position of the hit voxel in world coordinates
+   * \param distance Distance along the ray to the hit voxel in meters
+   *
+   * \returns True if an active voxel was hit within the maximum ray length
+   */
+  bool traceRay(const typename GridT::ConstAccessor& acc,
+                const openvdb::Vec3d& ray_origin_world,
+                const openvdb::Vec3d& ray_direction,
+                const double max_ray_length,
+                openvdb::Vec3d& end_point,
+                double& distance) const;
+
+  /*!
+   * \brief Selects the points whose rays have to be cast if endpoint deduplication is enabled
+   *
+   * Only the first point ending in each voxel is kept. Rays clipped at the raycasting range are
+   * keyed separately from rays ending in a hit, as they do not mark their end voxel as occupied.
+   *
+   * \param points Input points in map coordinates
+   * \param ray_origin_world Ray origin in world coordinates
+   * \param raycast_range Maximum raycasting range
+   *
+   * \returns Indices of all points whose rays are cast
+   */
+  std::vector<std::size_t> uniqueEndPoints(const PointSpan& points,
+                                           const openvdb::Vec3d& ray_origin_world,
+                                           const double raycast_range) const;
+
+  /*!
+   * \brief Generates a timestamped file name for a map in the map directory
+   */
+  std::string mapFileName() const;
+
+  /*!
+   * \brief Writes a grid to a temporary file and renames it to the target file name afterwards
+   *
+   * \param grid Grid to write
+   * \param file_path Target file path
+   *
+   * \returns True if the grid was written successfully
+   */
+  static bool writeGridFile(const openvdb::GridBase::ConstPtr& grid, const std::string& file_path);
+
+  /*!
+   * \brief Finds the leaf of the map which the current pruning pass visits next
+   *
+   * \param origin Origin of the next leaf
+   *
+   * \returns False if the pass visited all leaves
+   */
+  bool nextPruneLeaf(openvdb::Coord& origin) const;
+
+  /*!
+   * \brief Finds the first leaf of an internal node which follows a leaf origin in tree order
+   *
+   * \param node Internal node of the map
+   * \param after Origin of the leaf to start after, nullptr to find the first leaf of the node
+   * \param origin Origin of the found leaf
+   *
+   * \returns True if such a leaf exists
+   */
+  template <typename TNode>
+  static bool findNextLeaf(const TNode& node,
+                           const openvdb::Coord* after,
+                           openvdb::Coord& origin,
+                           std::true_type /*leaf_parent*/);
+  template <typename TNode>
+  static bool findNextLeaf(const TNode& node,
+                           const openvdb::Coord* after,
+                           openvdb::Coord& origin,
+                           std::false_type /*leaf_parent*/);
+
+  /*!
+   * \brief Reads the last grid of a map file, only reading its topology if delayed loading is
+   * enabled
+   *
+   * \param file_path Path of the map file
+   *
+   * \returns Grid of the file, null if the file holds no grid
+   */
+  typename GridT::Ptr readMapFile(const std::string& file_path) const;
+
+  /*!
+   * \brief Marks the topology of a grid as modified since the map was loaded
+   *
+   * \param topology Tree whose active voxels and tiles cover all modified voxels of the map
+   */
+  template <typename TTree>
+  void markMapModified(const TTree& topology);
+
+  /*!
+   * \brief Marks a region as modified since the map was loaded
+   *
+   * \param region Index space bounding box of the modified voxels
+   */
+  void markMapModified(const openvdb::CoordBBox& region);
+
+  /*!
+   * \brief Marks the topology of a grid as changed for both snapshot buffers
+   *
+   * \param topology Tree whose active voxels and tiles cover all changed voxels of the map
+   */
+  template <typename TTree>
+  void markSnapshotDirty(const TTree& topology);
+
+  /*!
+   * \brief Marks a region of the map as changed for both snapshot buffers
+   */
+  void markSnapshotDirty(const openvdb::CoordBBox& region);
+
+  /*!
+   * \brief Marks the whole map as replaced, so both snapshot buffers are copied completely
+   */
+  void markSnapshotResync();
+
+  /*!
+   * \brief Copies a region of the map into a snapshot buffer, replacing its previous content
+   *
+   * \param buffer Snapshot buffer
+   * \param region Index bounding box of the region
+   */
+  void replicateRegion(GridT& buffer, const openvdb::CoordBBox& region) const;
+
+  /*!
+   * \brief Computes the world region which can be modified by a sensor measurement
+   *
+   * \param points Input points in map coordinates
+   * \param origin Sensor position in map coordinates
+   * \param max_range Maximum raycasting range of this measurement, unlimited if not positive
+   *
+   * \returns Axis aligned bounding box of the region in world coordinates
+   */
+  openvdb::BBoxd measurementRegion(const PointSpan& points,
+                                   const Eigen::Matrix<double, 3, 1>& origin,
+                                   const double max_range) const;
+
+  /*!
+   * \brief Updates the resident tiles of a tiled map for the region modified by the next update
+   *
+   * All tiles overlapping the region are made resident, waiting for their pending loads if
+   * necessary. Tiles of the surrounding margin are prefetched asynchronously and all other resident
+   * tiles are evicted and written asynchronously.
+   *
+   * \param region World region which can be modified, see measurementRegion
+   */
+  void updateTileWindow(const openvdb::BBoxd& region);
+
+  /*!
+   * \brief Extracts a tile from the map and writes it to its file asynchronously
+   *
+   * \param tile Tile key
+   */
+  void evictTile(const openvdb::Coord& tile);
+
+  /*!
+   * \brief Starts loading a tile asynchronously if its file exists, otherwise marks it resident
+   *
+   * \param tile Tile key
+   */
+  void requestTile(const openvdb::Coord& tile);
+
+  /*!
+   * \brief Merges a loaded tile into the map and marks it resident
+   *
+   * \param tile Tile key
+   */
+  void finishTileLoad(const openvdb::Coord& tile);
+
+  /*!
+   * \brief Index bounding box covered by a tile
+   */
+  openvdb::CoordBBox tileBoundingBox(const openvdb::Coord& tile) const;
+
+  /*!
+   * \brief Path of the file of a tile in the map directory
+   */
+  std::string tilePath(const openvdb::Coord& tile) const;
+
+  /*!
+   * \brief Types of the journal entries
+   */
+  enum class JournalEntryType : std::uint8_t
+  {
+    UPDATE    = 0,
+    OVERWRITE = 1,
+    SECTION   = 2
+  };
+
+  /*!
+   * \brief Appends a grid to the journal if journaling is enabled
+   *
+   * Each entry consists of its type, its size in bytes and the grid serialized as OpenVDB stream.
+   *
+   * \param type Type of the entry, defining how it is replayed
+   * \param grid Update or overwrite grid or map section which was applied to the map
+   */
+  void appendJournalEntry(const JournalEntryType type, const openvdb::GridBase::ConstPtr& grid);
+
+  /*!
+   * \brief Applies all entries of a journal file to the map. A truncated last entry is ignored
+   *
+   * \param file_path Path of the journal
+   *
+   * \returns False if the journal does not exist
+   */
+  bool replayJournal(const std::string& file_path);
+
+  /*!
+   * \brief Path of the map checkpoint in the map directory
+   */
+  std::string checkpointPath() const;
+
+  /*!
+   * \brief Path of the journal of a generation in the map directory
+   */
+  std::string journalPath(const std::uint64_t generation) const;
+
+  /*!
+   * \brief Returns an empty update grid, reusing the nodes of an earlier grid if possible
+   *
+   * The grid handed out last is usually still referenced by the caller, so two grids alternate.
+   * If the grid of the call before is only referenced by the map, all its values are reset and
+   * deactivated while its allocated nodes are kept. Nodes are reused for all leaves which held
+   * active voxels during the last use of the grid, so voxels of the next update falling into these
+   * leaves do not allocate. Leaves which stayed empty during the whole last use are released, which
+   * bounds the grid to the region of its last use. Handed out grids may thus contain empty leaves,
+   * which have to be skipped when iterating over leaves. Otherwise a new grid is created.
+   *
+   * \param grid Last grid, replaced by the returned grid
+   * \param spare Grid of the call before, replaced by the last grid
+   *
+   * \returns Empty update grid
+   */
+  static typename UpdateGridT::Ptr recycleUpdateGrid(typename UpdateGridT::Ptr& grid,
+                                                     typename UpdateGridT::Ptr& spare);
+
+  /*!
+   * \brief Joins two partial update grids of a parallel reduction
+   *
+   * \param lhs Update grid which receives the merged data, may be empty
+   * \param rhs Update grid which is merged, may be empty
+   *
+   * \returns The joined update grid
+   */
+  typename UpdateGridT::Ptr joinUpdateGrids(const typename UpdateGridT::Ptr& lhs,
+                                            const typename UpdateGridT::Ptr& rhs) const;
+
+  /*!
+   * \brief Copies the part of a map node which overlaps a region into a section tree
+   *
+   * \param node Internal or root node of the map
+   * \param node_bbox Index bounding box covered by the node
+   * \param region Index bounding box of the section
+   * \param carry_values Copy the voxel values instead of only the active states
+   * \param section_tree Tree receiving the section
+   */
+  template <typename TResultTree, typename TNode>
+  void copySectionNode(const TNode& node,
+                       const openvdb::CoordBBox& node_bbox,
+                       const openvdb::CoordBBox& region,
+                       const bool carry_values,
+                       TResultTree& section_tree) const;
+
+  /*!
+   * \brief Copies the part of a map leaf which overlaps a region into a section tree
+   *
+   * \param leaf Leaf node of the map
+   * \param leaf_bbox Index bounding box covered by the leaf
+   * \param region Index bounding box of the section
+   * \param carry_values Copy the voxel values instead of only the active states
+   * \param section_tree Tree receiving the section
+   */
+  template <typename TResultTree>
+  void copySectionNode(const typename GridT::TreeType::LeafNodeType& leaf,
+                       const openvdb::CoordBBox& leaf_bbox,
+                       const openvdb::CoordBBox& region,
+                       const bool carry_values,
+                       TResultTree& section_tree) const;
+
+  /*!
+   * \brief Creates a section leaf from a map leaf, carrying the values if both types match
+   */
+  template <typename TResultLeaf>
+  TResultLeaf* sectionLeaf(const typename GridT::TreeType::LeafNodeType& leaf,
+                           const bool carry_values,
+                           std::true_type /*same_type*/) const;
+  template <typename TResultLeaf>
+  TResultLeaf* sectionLeaf(const typename GridT::TreeType::LeafNodeType& leaf,
+                           const bool carry_values,
+                           std::false_type /*same_type*/) const;
+
+  /*!
+   * \brief Converts a map value into a section value, carrying the value if both types match
+   */
+  template <typename TResultValue>
+  TResultValue sectionValue(const TData& value,
+                            const bool active,
+                            const bool carry_values,
+                            std::true_type /*same_type*/) const;
+  template <typename TResultValue>
+  TResultValue sectionValue(const TData& value,
+                            const bool active,
+                            const bool carry_values,
+                            std::false_type /*same_type*/) const;
+
+  /*!
+   * \brief Sets the active state of all voxels of the map within a region without changing their
+   * values
+   *
+   * \param region Index bounding box of the region
+   * \param active New active state
+   */
+  void setRegionActiveState(const openvdb::CoordBBox& region, const bool active);
+
+  /*!
+   * \brief Resets all voxels of the map within a region to the inactive background value
+   *
+   * \param region Index bounding box of the region
+   */
+  void clearRegion(const openvdb::CoordBBox& region);
+
+  /*!
+   * \brief Sets the active state of the part of a map node which overlaps a region
+   *
+   * \param node Internal or root node of the map
+   * \param node_bbox Index bounding box covered by the node
+   * \param region Index bounding box of the region
+   * \param active New active state
+   * \param value New value of the voxels, nullptr keeps the current values
+   * \param tiles Tiles whose state has to be changed, together with their new values
+   */
+  template <typename TNode>
+  void setNodeActiveState(TNode& node,
+                          const openvdb::CoordBBox& node_bbox,
+                          const openvdb::CoordBBox& region,
+                          const bool active,
+                          const TData* value,
+                          std::vector<std::pair<openvdb::CoordBBox, TData> >& tiles);
+
+  /*!
+   * \brief Sets the active state of the part of a map leaf which overlaps a region
+   *
+   * \param leaf Leaf node of the map
+   * \param leaf_bbox Index bounding box covered by the leaf
+   * \param region Index bounding box of the region
+   * \param active New active state
+   * \param value New value of the voxels, nullptr keeps the current values
+   * \param tiles Unused, only present to match the signature of the internal node overload
+   */
+  void setNodeActiveState(typename GridT::TreeType::LeafNodeType& leaf,
+                          const openvdb::CoordBBox& leaf_bbox,
+                          const openvdb::CoordBBox& region,
+                          const bool active,
+                          const TData* value,
+                          std::vector<std::pair<openvdb::CoordBBox, TData> >& tiles);
+
   virtual bool updateFreeNode(TData& voxel_value, bool& active) { return false; }
   virtual bool updateOccupiedNode(TData& voxel_value, bool& active) { return false; }
   /*!
@@ -384,8 +1629,125 @@ protected:
    * \brief Flag checking wether a valid config was already loaded
    */
   bool m_config_set;
+  /*!
+   * \brief Flag enabling the parallel raycasting of point clouds
+   */
+  bool m_parallel_raycasting;
+  /*!
+   * \brief Flag enabling the leaf parallel integration of update grids
+   */
+  bool m_parallel_integration;
+  /*!
+   * \brief Flag enabling the deduplication of ray end voxels before raycasting
+   */
+  bool m_deduplicate_endpoints;
+  /*!
+   * \brief Flag enabling the journaling of all map updates
+   */
+  bool m_journaling;
+  /*!
+   * \brief Flag enabling delayed loading of maps
+   */
+  bool m_delayed_loading;
+  /*!
+   * \brief Maximum number of resident leaves of a delayed loaded map, zero disables the limit
+   */
+  std::size_t m_max_resident_leaves;
+  /*!
+   * \brief Topology of a delayed loaded map as read from its file, whose out of core leaves replace
+   * evicted leaves of the map. Null if the map was not loaded with delayed loading
+   */
+  typename GridT::Ptr m_paged_grid;
+  /*!
+   * \brief Voxels of a delayed loaded map which were modified since it was loaded, null if none
+   */
+  typename UpdateGridT::Ptr m_modified_region;
+  /*!
+   * \brief Edge length of the map tiles in voxels, zero disables the tiling
+   */
+  openvdb::Int32 m_tile_voxels;
+  /*!
+   * \brief Number of tiles kept resident around the raycasting range of the sensor
+   */
+  unsigned int m_tile_margin;
+  /*!
+   * \brief Keys of all tiles which are held in the map
+   */
+  std::set<openvdb::Coord> m_resident_tiles;
+  /*!
+   * \brief Pending asynchronous loads of tiles
+   */
+  std::map<openvdb::Coord, std::future<typename GridT::Ptr> > m_tile_loads;
+  /*!
+   * \brief Loads of tiles which left the tile window, kept until they finished in the background
+   */
+  std::vector<std::future<typename GridT::Ptr> > m_discarded_tile_loads;
+  /*!
+   * \brief Pending asynchronous writes of evicted tiles
+   */
+  std::map<openvdb::Coord, std::future<bool> > m_tile_writes;
+  /*!
+   * \brief Flag enabling the publication of snapshots
+   */
+  bool m_publish_snapshots;
+  /*!
+   * \brief Most recently published snapshot, accessed atomically
+   */
+  typename GridT::ConstPtr m_snapshot;
+  /*!
+   * \brief Snapshot buffers which are published alternately
+   */
+  std::array<typename GridT::Ptr, 2> m_snapshot_buffers;
+  /*!
+   * \brief Changes of the map since each snapshot buffer was published last
+   */
+  std::array<typename UpdateGridT::Ptr, 2> m_snapshot_dirty;
+  /*!
+   * \brief Flags stating whether the snapshot buffers have to be copied completely
+   */
+  std::array<bool, 2> m_snapshot_resync;
+  /*!
+   * \brief Index of the snapshot buffer which is currently published
+   */
+  std::size_t m_published_buffer;
+  /*!
+   * \brief Number of journal entries after which a checkpoint is written, zero disables it
+   */
+  unsigned int m_journal_checkpoint_interval;
+  /*!
+   * \brief Generation of the currently open journal
+   */
+  std::uint64_t m_journal_generation;
+  /*!
+   * \brief Number of entries in the currently open journal
+   */
+  std::size_t m_journal_entries;
+  /*!
+   * \brief Flag suppressing the journaling while a journal is replayed
+   */
+  bool m_replaying_journal;
+  /*!
+   * \brief Stream of the currently open journal
+   */
+  std::ofstream m_journal;
 
-  UpdateGridT::Ptr m_update_grid;
+  /*!
+   * \brief Origin of the leaf which the current pruning pass visited last
+   */
+  openvdb::Coord m_prune_origin;
+  /*!
+   * \brief Flag indicating that a pruning pass is in progress, which continues after the leaf at
+   * m_prune_origin
+   */
+  bool m_prune_pass_active;
+
+  typename UpdateGridT::Ptr m_update_grid;
+  typename UpdateGridT::Ptr m_spare_update_grid;
+  /*!
+   * \brief Change grids of the last two map updates, see recycleUpdateGrid
+   */
+  typename UpdateGridT::Ptr m_change_grid;
+  typename UpdateGridT::Ptr m_spare_change_grid;
 };
 
 #include "VDBMapping.hpp"
@@ -27,12 +27,32 @@
 //----------------------------------------------------------------------
 
 
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
-template <typename TData, typename TConfig>
-VDBMapping<TData, TConfig>::VDBMapping(const double resolution)
+template <typename TData, typename TConfig, typename TTreeLayout>
+VDBMapping<TData, TConfig, TTreeLayout>::VDBMapping(const double resolution)
   : m_resolution(resolution)
   , m_config_set(false)
+  , m_parallel_raycasting(false)
+  , m_parallel_integration(false)
+  , m_deduplicate_endpoints(false)
+  , m_journaling(false)
+  , m_delayed_loading(false)
+  , m_max_resident_leaves(0)
+  , m_tile_voxels(0)
+  , m_tile_margin(1)
+  , m_publish_snapshots(false)
+  , m_snapshot_resync{{true, true}}
+  , m_published_buffer(0)
+  , m_journal_checkpoint_interval(0)
+  , m_journal_generation(0)
+  , m_journal_entries(0)
+  , m_replaying_journal(false)
+  , m_prune_pass_active(false)
 {
   // Initialize Grid
   openvdb::initialize();
@@ -48,17 +68,45 @@ VDBMapping<TData, TConfig>::VDBMapping(const double resolution)
   m_update_grid = UpdateGridT::create(false);
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::resetMap()
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::resetMap()
 {
   m_vdb_grid->clear();
   m_vdb_grid    = createVDBMap(m_resolution);
   m_update_grid = UpdateGridT::create(false);
+  m_paged_grid.reset();
+  m_modified_region.reset();
+  m_prune_pass_active = false;
+  markSnapshotResync();
+  if (m_journal.is_open() && !m_replaying_journal)
+  {
+    // Journaled updates of the previous map must not be replayed onto the empty map
+    checkpointMap();
+  }
+}
+
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::saveMap() const
+{
+  std::string map_name = mapFileName();
+  std::cout << map_name << std::endl;
+  return writeGridFile(m_vdb_grid, map_name);
 }
 
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::future<bool> VDBMapping<TData, TConfig, TTreeLayout>::saveMapAsync() const
+{
+  std::string map_name = mapFileName();
+  std::cout << map_name << std::endl;
+  // The snapshot shares no data with the map, so the map can be modified during serialization
+  openvdb::GridBase::ConstPtr snapshot = m_vdb_grid->deepCopy();
+  return std::async(std::launch::async,
+                    [snapshot, map_name]() { return writeGridFile(snapshot, map_name); });
+}
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::saveMap() const
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::string VDBMapping<TData, TConfig, TTreeLayout>::mapFileName() const
 {
   auto timestamp     = std::chrono::system_clock::now();
   std::time_t now_tt = std::chrono::system_clock::to_time_t(timestamp);
@@ -66,40 +114,491 @@ bool VDBMapping<TData, TConfig>::saveMap() const
   std::stringstream sstime;
   sstime << std::put_time(&tm, "%Y-%m-%d_%H-%M-%S");
 
-  std::string map_name = m_map_directory_path + sstime.str() + "_map.vdb";
-  std::cout << map_name << std::endl;
-  openvdb::io::File file_handle(map_name);
-  openvdb::GridPtrVec grids;
-  grids.push_back(m_vdb_grid);
-  file_handle.write(grids);
-  file_handle.close();
+  return m_map_directory_path + sstime.str() + "_map.vdb";
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::writeGridFile(const openvdb::GridBase::ConstPtr& grid,
+                                                            const std::string& file_path)
+{
+  // Readers of the map directory only ever see complete map files
+  const std::string temp_path = file_path + ".tmp";
+  try
+  {
+    openvdb::io::File file_handle(temp_path);
+    openvdb::GridCPtrVec grids;
+    grids.push_back(grid);
+    file_handle.write(grids);
+    file_handle.close();
+  }
+  catch (const openvdb::Exception& e)
+  {
+    std::cerr << "Writing map " << temp_path << " failed: " << e.what() << std::endl;
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  if (std::rename(temp_path.c_str(), file_path.c_str()) != 0)
+  {
+    std::cerr << "Renaming map " << temp_path << " to " << file_path << " failed" << std::endl;
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::loadMap(const std::string& file_path)
+{
+  typename GridT::Ptr grid = readMapFile(file_path);
+  if (grid)
+  {
+    m_vdb_grid->clear();
+    m_vdb_grid = grid;
+  }
+
+  // A second, untouched copy of the topology keeps the out of core leaves of the file at hand for
+  // paging out leaves again later on
+  m_paged_grid = m_delayed_loading && grid ? readMapFile(file_path) : typename GridT::Ptr();
+  m_modified_region.reset();
+  m_prune_pass_active = false;
+  markSnapshotResync();
 
   return true;
 }
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::loadMap(const std::string& file_path)
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::GridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::readMapFile(const std::string& file_path) const
 {
   openvdb::io::File file_handle(file_path);
-  file_handle.open();
-  openvdb::GridBase::Ptr base_grid;
+  if (m_delayed_loading)
+  {
+    // Map the file directly instead of copying it to a temporary file first
+    file_handle.setCopyMaxBytes(0);
+  }
+  file_handle.open(m_delayed_loading);
+  typename GridT::Ptr grid;
   for (openvdb::io::File::NameIterator name_iter = file_handle.beginName();
        name_iter != file_handle.endName();
        ++name_iter)
   {
-    base_grid = file_handle.readGrid(name_iter.gridName());
-    m_vdb_grid->clear();
-    m_vdb_grid = openvdb::gridPtrCast<GridT>(base_grid);
+    grid = openvdb::gridPtrCast<GridT>(file_handle.readGrid(name_iter.gridName()));
   }
   file_handle.close();
+  return grid;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::size_t VDBMapping<TData, TConfig, TTreeLayout>::residentLeafCount() const
+{
+  std::size_t resident_leaves = 0;
+  for (auto leaf_iter = m_vdb_grid->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    if (!leaf_iter->buffer().isOutOfCore())
+    {
+      ++resident_leaves;
+    }
+  }
+  return resident_leaves;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::enforceResidentLeafLimit()
+{
+  using LeafT = typename GridT::TreeType::LeafNodeType;
+
+  if (!m_paged_grid || m_max_resident_leaves == 0)
+  {
+    return true;
+  }
+  std::size_t resident_leaves = 0;
+  std::vector<openvdb::Coord> evictable_leaves;
+  for (auto leaf_iter = m_vdb_grid->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    if (leaf_iter->buffer().isOutOfCore())
+    {
+      continue;
+    }
+    ++resident_leaves;
+    const openvdb::Coord& origin = leaf_iter->origin();
+    const typename UpdateGridT::TreeType::LeafNodeType* modified_leaf =
+      m_modified_region ? m_modified_region->tree().probeConstLeaf(origin) : nullptr;
+    const bool modified = (modified_leaf && !modified_leaf->isEmpty()) ||
+                          (m_modified_region && m_modified_region->tree().isValueOn(origin));
+    if (!modified)
+    {
+      evictable_leaves.push_back(origin);
+    }
+  }
+  if (resident_leaves <= m_max_resident_leaves)
+  {
+    return true;
+  }
+
+  // Copies of the out of core leaves stay out of core, so the paged grid can serve the same leaf
+  // again once it was paged in another time
+  for (const openvdb::Coord& origin : evictable_leaves)
+  {
+    if (resident_leaves <= m_max_resident_leaves)
+    {
+      break;
+    }
+    const LeafT* paged_leaf = m_paged_grid->tree().probeConstLeaf(origin);
+    if (paged_leaf)
+    {
+      m_vdb_grid->tree().addLeaf(new LeafT(*paged_leaf));
+      --resident_leaves;
+    }
+  }
+  m_vdb_grid->tree().clearAllAccessors();
+  if (resident_leaves > m_max_resident_leaves)
+  {
+    std::cerr << "Map holds " << resident_leaves << " modified resident leaves, which exceeds the "
+              << "limit of " << m_max_resident_leaves << std::endl;
+    return false;
+  }
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+PruneStatistics
+VDBMapping<TData, TConfig, TTreeLayout>::pruneMap(const std::chrono::microseconds& budget)
+{
+  using LeafT = typename GridT::TreeType::LeafNodeType;
+
+  typename GridT::TreeType& tree = m_vdb_grid->tree();
+  PruneStatistics statistics;
+  std::size_t steps = 0;
+  const auto start  = std::chrono::steady_clock::now();
+  while (steps == 0 || std::chrono::steady_clock::now() - start < budget)
+  {
+    ++steps;
+    openvdb::Coord origin;
+    if (!nextPruneLeaf(origin))
+    {
+      m_prune_pass_active = false;
+      statistics.complete = true;
+      break;
+    }
+    m_prune_origin      = origin;
+    m_prune_pass_active = true;
+    const LeafT* leaf   = tree.probeConstLeaf(origin);
+    if (leaf->buffer().isOutOfCore())
+    {
+      continue;
+    }
+    ++statistics.visited_leaves;
+
+    TData value;
+    bool active;
+    if (leaf->isConstant(value, active))
+    {
+      statistics.reclaimed_bytes += leaf->memUsage();
+      ++statistics.collapsed_leaves;
+      // Replaces the leaf by a tile of its parent node, the pass continues after its origin
+      tree.addTile(1, origin, value, active);
+    }
+  }
+  if (statistics.collapsed_leaves > 0)
+  {
+    tree.clearAllAccessors();
+  }
+  return statistics;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::nextPruneLeaf(openvdb::Coord& origin) const
+{
+  using RootT  = typename GridT::TreeType::RootNodeType;
+  using ChildT = typename RootT::ChildNodeType;
+  using LeafT  = typename GridT::TreeType::LeafNodeType;
+
+  // Children of the root are ordered by their origin, so the ones before the child containing the
+  // last visited leaf are skipped without descending into them
+  const openvdb::Coord* after = m_prune_pass_active ? &m_prune_origin : nullptr;
+  const openvdb::Coord key    = m_prune_origin & ~(static_cast<openvdb::Int32>(ChildT::DIM) - 1);
+  for (auto iter = m_vdb_grid->tree().root().cbeginChildOn(); iter; ++iter)
+  {
+    const openvdb::Coord child_origin = iter.getCoord();
+    if (after && child_origin < key)
+    {
+      continue;
+    }
+    if (findNextLeaf(*iter,
+                     after && child_origin == key ? after : nullptr,
+                     origin,
+                     std::is_same<typename ChildT::ChildNodeType, LeafT>()))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TNode>
+bool VDBMapping<TData, TConfig, TTreeLayout>::findNextLeaf(const TNode& node,
+                                                           const openvdb::Coord* after,
+                                                           openvdb::Coord& origin,
+                                                           std::true_type /*leaf_parent*/)
+{
+  const openvdb::Index start = after ? TNode::coordToOffset(*after) : 0;
+  openvdb::Index n           = node.getChildMask().findNextOn(start);
+  if (after && n == start)
+  {
+    n = node.getChildMask().findNextOn(n + 1);
+  }
+  if (n >= TNode::NUM_VALUES)
+  {
+    return false;
+  }
+  origin = node.offsetToGlobalCoord(n);
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TNode>
+bool VDBMapping<TData, TConfig, TTreeLayout>::findNextLeaf(const TNode& node,
+                                                           const openvdb::Coord* after,
+                                                           openvdb::Coord& origin,
+                                                           std::false_type /*leaf_parent*/)
+{
+  using ChildT = typename TNode::ChildNodeType;
+  using LeafT  = typename GridT::TreeType::LeafNodeType;
+
+  const openvdb::Index start = after ? TNode::coordToOffset(*after) : 0;
+  for (openvdb::Index n = node.getChildMask().findNextOn(start); n < TNode::NUM_VALUES;
+       n = node.getChildMask().findNextOn(n + 1))
+  {
+    const ChildT* child = node.template probeConstNode<ChildT>(node.offsetToGlobalCoord(n));
+    if (findNextLeaf(*child,
+                     after && n == start ? after : nullptr,
+                     origin,
+                     std::is_same<typename ChildT::ChildNodeType, LeafT>()))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::checkpointMap()
+{
+  std::uint64_t generation = m_journal_generation + 1;
+  if (!m_journal.is_open())
+  {
+    // Continue after the newest generation on disk, so that no journal of an earlier session is
+    // replayed on top of this checkpoint
+    generation = 0;
+    std::ifstream checkpoint_file(checkpointPath());
+    if (checkpoint_file.good())
+    {
+      openvdb::io::File file_handle(checkpointPath());
+      file_handle.open(false);
+      openvdb::GridPtrVecPtr grids = file_handle.readAllGridMetadata();
+      file_handle.close();
+      if (!grids->empty())
+      {
+        openvdb::Int64Metadata::ConstPtr generation_meta =
+          grids->front()->template getMetadata<openvdb::Int64Metadata>("journal_generation");
+        generation = generation_meta ? static_cast<std::uint64_t>(generation_meta->value()) : 0;
+      }
+    }
+    while (std::ifstream(journalPath(generation)).good())
+    {
+      ++generation;
+    }
+  }
+  m_journal.close();
+
+  // The checkpoint shares the tree of the map and only carries its own metadata
+  openvdb::GridBase::Ptr checkpoint = m_vdb_grid->copyGrid();
+  checkpoint->insertMeta("journal_generation",
+                         openvdb::Int64Metadata(static_cast<openvdb::Int64>(generation)));
+  if (!writeGridFile(checkpoint, checkpointPath()))
+  {
+    return false;
+  }
+  // All older journals are contained in the checkpoint now
+  for (std::uint64_t old_generation = generation; old_generation > 0; --old_generation)
+  {
+    if (std::remove(journalPath(old_generation - 1).c_str()) != 0)
+    {
+      break;
+    }
+  }
 
+  m_journal_generation = generation;
+  m_journal_entries    = 0;
+  m_journal.open(journalPath(generation), std::ios::binary | std::ios::app);
+  if (!m_journal)
+  {
+    std::cerr << "Opening journal " << journalPath(generation) << " failed" << std::endl;
+    m_journal.close();
+    return false;
+  }
+  return true;
+}
 
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::loadJournaledMap()
+{
+  m_journal.close();
+  std::uint64_t generation = 0;
+  if (std::ifstream(checkpointPath()).good())
+  {
+    loadMap(checkpointPath());
+    openvdb::Int64Metadata::ConstPtr generation_meta =
+      m_vdb_grid->template getMetadata<openvdb::Int64Metadata>("journal_generation");
+    if (generation_meta)
+    {
+      generation = static_cast<std::uint64_t>(generation_meta->value());
+      m_vdb_grid->removeMeta("journal_generation");
+    }
+  }
+  else
+  {
+    resetMap();
+  }
+
+  m_replaying_journal = true;
+  while (replayJournal(journalPath(generation)))
+  {
+    ++generation;
+  }
+  m_replaying_journal = false;
+
+  if (m_journaling)
+  {
+    return checkpointMap();
+  }
   return true;
 }
 
-template <typename TData, typename TConfig>
-typename VDBMapping<TData, TConfig>::GridT::Ptr
-VDBMapping<TData, TConfig>::createVDBMap(double resolution)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::appendJournalEntry(
+  const JournalEntryType type, const openvdb::GridBase::ConstPtr& grid)
+{
+  if (!m_journaling || m_replaying_journal)
+  {
+    return;
+  }
+  if (!m_journal.is_open() && !checkpointMap())
+  {
+    std::cerr << "Journal could not be started, update is not persisted" << std::endl;
+    return;
+  }
+
+  std::ostringstream buffer(std::ios_base::binary);
+  openvdb::GridCPtrVec grids;
+  grids.push_back(grid);
+  openvdb::io::Stream(buffer).write(grids);
+  const std::string data        = buffer.str();
+  const std::uint8_t entry_type = static_cast<std::uint8_t>(type);
+  const std::uint64_t size      = data.size();
+  m_journal.write(reinterpret_cast<const char*>(&entry_type), sizeof(entry_type));
+  m_journal.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  m_journal.write(data.data(), static_cast<std::streamsize>(size));
+  m_journal.flush();
+  if (!m_journal)
+  {
+    std::cerr << "Writing journal " << journalPath(m_journal_generation) << " failed" << std::endl;
+    m_journal.close();
+    return;
+  }
+
+  if (m_journal_checkpoint_interval > 0 && ++m_journal_entries >= m_journal_checkpoint_interval)
+  {
+    checkpointMap();
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::replayJournal(const std::string& file_path)
+{
+  std::ifstream journal(file_path, std::ios::binary);
+  if (!journal)
+  {
+    return false;
+  }
+  std::uint8_t entry_type;
+  std::uint64_t size;
+  while (journal.read(reinterpret_cast<char*>(&entry_type), sizeof(entry_type)) &&
+         journal.read(reinterpret_cast<char*>(&size), sizeof(size)))
+  {
+    std::string data(size, '\0');
+    if (!journal.read(&data[0], static_cast<std::streamsize>(size)))
+    {
+      std::cerr << "Ignoring truncated entry at the end of journal " << file_path << std::endl;
+      break;
+    }
+    openvdb::GridBase::Ptr base_grid;
+    try
+    {
+      std::istringstream stream(data, std::ios_base::binary);
+      openvdb::GridPtrVecPtr grids = openvdb::io::Stream(stream, false).getGrids();
+      if (grids && !grids->empty())
+      {
+        base_grid = grids->front();
+      }
+    }
+    catch (const openvdb::Exception& e)
+    {
+      std::cerr << "Reading entry of journal " << file_path << " failed: " << e.what()
+                << std::endl;
+      break;
+    }
+    if (!base_grid)
+    {
+      continue;
+    }
+    if (static_cast<JournalEntryType>(entry_type) == JournalEntryType::SECTION)
+    {
+      // Sections either carry map values or only active states
+      if (typename GridT::Ptr section = openvdb::gridPtrCast<GridT>(base_grid))
+      {
+        applyMapSectionGrid(section);
+      }
+      else if (typename UpdateGridT::Ptr section = openvdb::gridPtrCast<UpdateGridT>(base_grid))
+      {
+        applyMapSectionUpdateGrid(section);
+      }
+      continue;
+    }
+    typename UpdateGridT::Ptr grid = openvdb::gridPtrCast<UpdateGridT>(base_grid);
+    if (!grid)
+    {
+      continue;
+    }
+    if (static_cast<JournalEntryType>(entry_type) == JournalEntryType::OVERWRITE)
+    {
+      overwriteMap(grid);
+    }
+    else
+    {
+      updateMap(grid);
+    }
+  }
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::string VDBMapping<TData, TConfig, TTreeLayout>::checkpointPath() const
+{
+  return m_map_directory_path + "checkpoint.vdb";
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::string VDBMapping<TData, TConfig, TTreeLayout>::journalPath(
+  const std::uint64_t generation) const
+{
+  return m_map_directory_path + "journal_" + std::to_string(generation) + ".vdbj";
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::GridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::createVDBMap(double resolution)
 {
   typename GridT::Ptr new_map = GridT::create(TData());
   new_map->setTransform(openvdb::math::Transform::createLinearTransform(m_resolution));
@@ -107,48 +606,30 @@ VDBMapping<TData, TConfig>::createVDBMap(double resolution)
   return new_map;
 }
 
-template <typename TData, typename TConfig>
-openvdb::BBoxd VDBMapping<TData, TConfig>::createWorldBoundingBox(
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::BBoxd VDBMapping<TData, TConfig, TTreeLayout>::createWorldBoundingBox(
   const Eigen::Matrix<double, 3, 1>& min_boundary,
   const Eigen::Matrix<double, 3, 1>& max_boundary,
   const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
 {
-  pcl::PointCloud<pcl::PointXYZ>::Ptr corners(new pcl::PointCloud<pcl::PointXYZ>());
-  corners->points.emplace_back(static_cast<float>(min_boundary.x()),
-                               static_cast<float>(min_boundary.y()),
-                               static_cast<float>(min_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(min_boundary.x()),
-                               static_cast<float>(min_boundary.y()),
-                               static_cast<float>(max_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(min_boundary.x()),
-                               static_cast<float>(max_boundary.y()),
-                               static_cast<float>(min_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(min_boundary.x()),
-                               static_cast<float>(max_boundary.y()),
-                               static_cast<float>(max_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(max_boundary.x()),
-                               static_cast<float>(min_boundary.y()),
-                               static_cast<float>(min_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(max_boundary.x()),
-                               static_cast<float>(min_boundary.y()),
-                               static_cast<float>(max_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(max_boundary.x()),
-                               static_cast<float>(max_boundary.y()),
-                               static_cast<float>(min_boundary.z()));
-  corners->points.emplace_back(static_cast<float>(max_boundary.x()),
-                               static_cast<float>(max_boundary.y()),
-                               static_cast<float>(max_boundary.z()));
-  pcl::transformPointCloud(*corners, *corners, map_to_reference_tf);
-  pcl::PointXYZ min_pt;
-  pcl::PointXYZ max_pt;
-  pcl::getMinMax3D(*corners, min_pt, max_pt);
-
-  return openvdb::BBoxd(openvdb::Vec3d(min_pt.x, min_pt.y, min_pt.z),
-                        openvdb::Vec3d(max_pt.x, max_pt.y, max_pt.z));
-}
-
-template <typename TData, typename TConfig>
-openvdb::CoordBBox VDBMapping<TData, TConfig>::createIndexBoundingBox(
+  const Eigen::Matrix<double, 4, 4>& tf = map_to_reference_tf;
+  openvdb::BBoxd world_bb;
+  for (int corner = 0; corner < 8; ++corner)
+  {
+    // Corners and results are rounded to float precision like the coordinates of a point cloud
+    const double x = static_cast<float>((corner & 4) ? max_boundary.x() : min_boundary.x());
+    const double y = static_cast<float>((corner & 2) ? max_boundary.y() : min_boundary.y());
+    const double z = static_cast<float>((corner & 1) ? max_boundary.z() : min_boundary.z());
+    world_bb.expand(openvdb::Vec3d(
+      static_cast<float>(tf(0, 0) * x + tf(0, 1) * y + tf(0, 2) * z + tf(0, 3)),
+      static_cast<float>(tf(1, 0) * x + tf(1, 1) * y + tf(1, 2) * z + tf(1, 3)),
+      static_cast<float>(tf(2, 0) * x + tf(2, 1) * y + tf(2, 2) * z + tf(2, 3))));
+  }
+  return world_bb;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::CoordBBox VDBMapping<TData, TConfig, TTreeLayout>::createIndexBoundingBox(
   const Eigen::Matrix<double, 3, 1>& min_boundary,
   const Eigen::Matrix<double, 3, 1>& max_boundary,
   const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
@@ -159,165 +640,1067 @@ openvdb::CoordBBox VDBMapping<TData, TConfig>::createIndexBoundingBox(
   openvdb::Vec3d min_index = m_vdb_grid->worldToIndex(world_bb.min());
   openvdb::Vec3d max_index = m_vdb_grid->worldToIndex(world_bb.max());
 
-  return {openvdb::Coord::floor(min_index), openvdb::Coord::floor(max_index)};
+  return {openvdb::Coord::floor(min_index), openvdb::Coord::floor(max_index)};
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::createIndexBoundingBoxes(
+  const Eigen::Matrix<double, 3, 1>& min_boundary,
+  const Eigen::Matrix<double, 3, 1>& max_boundary,
+  const TransformVectorT& map_to_reference_tfs,
+  std::vector<openvdb::CoordBBox>& bounding_boxes) const
+{
+  bounding_boxes.resize(map_to_reference_tfs.size());
+  for (std::size_t i = 0; i < map_to_reference_tfs.size(); ++i)
+  {
+    bounding_boxes[i] = createIndexBoundingBox(min_boundary, max_boundary, map_to_reference_tfs[i]);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::getMapSectionUpdateGrid(
+  const Eigen::Matrix<double, 3, 1>& min_boundary,
+  const Eigen::Matrix<double, 3, 1>& max_boundary,
+  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
+{
+  return getMapSection<typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT>(
+    min_boundary, max_boundary, map_to_reference_tf);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::GridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::getMapSectionGrid(
+  const Eigen::Matrix<double, 3, 1>& min_boundary,
+  const Eigen::Matrix<double, 3, 1>& max_boundary,
+  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf,
+  const bool copy_values) const
+{
+  return getMapSection<typename VDBMapping<TData, TConfig, TTreeLayout>::GridT>(
+    min_boundary, max_boundary, map_to_reference_tf, copy_values);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultGrid>
+typename TResultGrid::Ptr VDBMapping<TData, TConfig, TTreeLayout>::getMapSection(
+  const Eigen::Matrix<double, 3, 1>& min_boundary,
+  const Eigen::Matrix<double, 3, 1>& max_boundary,
+  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf,
+  const bool copy_values) const
+{
+  typename TResultGrid::Ptr temp_grid = TResultGrid::create(false);
+  temp_grid->setTransform(openvdb::math::Transform::createLinearTransform(m_resolution));
+
+  openvdb::CoordBBox bounding_box(
+    createIndexBoundingBox(min_boundary, max_boundary, map_to_reference_tf));
+
+  const bool carry_values =
+    copy_values && std::is_same<typename TResultGrid::ValueType, TData>::value;
+  copySectionNode(
+    m_vdb_grid->tree().root(), bounding_box, bounding_box, carry_values, temp_grid->tree());
+
+  openvdb::Vec3d min(bounding_box.min().x(), bounding_box.min().y(), bounding_box.min().z());
+  openvdb::Vec3d max(bounding_box.max().x(), bounding_box.max().y(), bounding_box.max().z());
+  temp_grid->insertMeta("bb_min", openvdb::Vec3DMetadata(min));
+  temp_grid->insertMeta("bb_max", openvdb::Vec3DMetadata(max));
+  temp_grid->insertMeta("values", openvdb::BoolMetadata(carry_values));
+  return temp_grid;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultTree, typename TNode>
+void VDBMapping<TData, TConfig, TTreeLayout>::copySectionNode(const TNode& node,
+                                                              const openvdb::CoordBBox& node_bbox,
+                                                              const openvdb::CoordBBox& region,
+                                                              const bool carry_values,
+                                                              TResultTree& section_tree) const
+{
+  using ChildT       = typename TNode::ChildNodeType;
+  using ResultValueT = typename TResultTree::ValueType;
+  using SameType     = std::is_same<ResultValueT, TData>;
+
+  openvdb::CoordBBox clipped_bbox = node_bbox;
+  clipped_bbox.intersect(region);
+  if (clipped_bbox.empty())
+  {
+    return;
+  }
+
+  // Visit every child slot of the node which overlaps the region, starting at the slot origin
+  const openvdb::Int32 child_dim = static_cast<openvdb::Int32>(ChildT::DIM);
+  const openvdb::Coord start     = clipped_bbox.min() & ~(child_dim - 1);
+  const TData& background        = m_vdb_grid->background();
+  openvdb::Coord xyz;
+  for (xyz.x() = start.x(); xyz.x() <= clipped_bbox.max().x(); xyz.x() += child_dim)
+  {
+    for (xyz.y() = start.y(); xyz.y() <= clipped_bbox.max().y(); xyz.y() += child_dim)
+    {
+      for (xyz.z() = start.z(); xyz.z() <= clipped_bbox.max().z(); xyz.z() += child_dim)
+      {
+        const openvdb::CoordBBox child_bbox = openvdb::CoordBBox::createCube(xyz, child_dim);
+        if (const ChildT* child = node.template probeConstNode<ChildT>(xyz))
+        {
+          copySectionNode(*child, child_bbox, region, carry_values, section_tree);
+          continue;
+        }
+
+        TData value;
+        const bool active = node.probeValue(xyz, value);
+        if (active || (carry_values && value != background))
+        {
+          openvdb::CoordBBox tile_bbox = child_bbox;
+          tile_bbox.intersect(region);
+          section_tree.fill(
+            tile_bbox,
+            sectionValue<ResultValueT>(value, active, carry_values, SameType()),
+            active);
+        }
+      }
+    }
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultTree>
+void VDBMapping<TData, TConfig, TTreeLayout>::copySectionNode(
+  const typename GridT::TreeType::LeafNodeType& leaf,
+  const openvdb::CoordBBox& leaf_bbox,
+  const openvdb::CoordBBox& region,
+  const bool carry_values,
+  TResultTree& section_tree) const
+{
+  using ResultLeafT  = typename TResultTree::LeafNodeType;
+  using ResultValueT = typename TResultTree::ValueType;
+  using SameType     = std::is_same<ResultValueT, TData>;
+
+  if (region.isInside(leaf_bbox))
+  {
+    section_tree.addLeaf(sectionLeaf<ResultLeafT>(leaf, carry_values, SameType()));
+    return;
+  }
+
+  const TData& background   = m_vdb_grid->background();
+  ResultLeafT* section_leaf = nullptr;
+  for (auto iter = leaf.cbeginValueAll(); iter; ++iter)
+  {
+    const bool active = iter.isValueOn();
+    if (!(active || (carry_values && *iter != background)) || !region.isInside(iter.getCoord()))
+    {
+      continue;
+    }
+    if (section_leaf == nullptr)
+    {
+      section_leaf = section_tree.touchLeaf(leaf.origin());
+    }
+    section_leaf->setValueOnly(
+      iter.pos(), sectionValue<ResultValueT>(*iter, active, carry_values, SameType()));
+    section_leaf->setActiveState(iter.pos(), active);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultLeaf>
+TResultLeaf* VDBMapping<TData, TConfig, TTreeLayout>::sectionLeaf(
+  const typename GridT::TreeType::LeafNodeType& leaf,
+  const bool carry_values,
+  std::true_type /*same_type*/) const
+{
+  if (carry_values)
+  {
+    return new TResultLeaf(leaf);
+  }
+  return new TResultLeaf(leaf, TData(false), TData(true), openvdb::TopologyCopy());
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultLeaf>
+TResultLeaf* VDBMapping<TData, TConfig, TTreeLayout>::sectionLeaf(
+  const typename GridT::TreeType::LeafNodeType& leaf,
+  const bool /*carry_values*/,
+  std::false_type /*same_type*/) const
+{
+  using ResultValueT = typename TResultLeaf::ValueType;
+  return new TResultLeaf(leaf, ResultValueT(false), ResultValueT(true), openvdb::TopologyCopy());
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultValue>
+TResultValue VDBMapping<TData, TConfig, TTreeLayout>::sectionValue(
+  const TData& value,
+  const bool active,
+  const bool carry_values,
+  std::true_type /*same_type*/) const
+{
+  return carry_values ? value : TData(active);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TResultValue>
+TResultValue VDBMapping<TData, TConfig, TTreeLayout>::sectionValue(
+  const TData& /*value*/,
+  const bool active,
+  const bool /*carry_values*/,
+  std::false_type /*same_type*/) const
+{
+  return TResultValue(active);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::applyMapSectionGrid(const typename GridT::Ptr section)
+{
+  applyMapSection<typename VDBMapping<TData, TConfig, TTreeLayout>::GridT>(section);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::applyMapSectionUpdateGrid(
+  const typename UpdateGridT::Ptr section)
+{
+  applyMapSection<typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT>(section);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TSectionGrid>
+void VDBMapping<TData, TConfig, TTreeLayout>::applyMapSection(typename TSectionGrid::Ptr section)
+{
+  using SectionTreeT = typename TSectionGrid::TreeType;
+  using LeafT        = typename GridT::TreeType::LeafNodeType;
+
+  openvdb::Vec3d min = section->template metaValue<openvdb::Vec3d>("bb_min");
+  openvdb::Vec3d max = section->template metaValue<openvdb::Vec3d>("bb_max");
+  openvdb::CoordBBox bbox(openvdb::Coord::floor(min), openvdb::Coord::floor(max));
+
+  openvdb::BoolMetadata::ConstPtr values_meta =
+    section->template getMetadata<openvdb::BoolMetadata>("values");
+  const bool carry_values = values_meta && values_meta->value();
+
+  appendJournalEntry(JournalEntryType::SECTION, section);
+  markMapModified(bbox);
+  markSnapshotDirty(bbox);
+  markSnapshotDirty(section->tree());
+  // Sections carrying values replace the whole region, so voxels the section does not cover
+  // fall back to the background instead of keeping stale values
+  if (carry_values)
+  {
+    clearRegion(bbox);
+  }
+  else
+  {
+    setRegionActiveState(bbox, false);
+  }
+
+  typename GridT::TreeType& tree = m_vdb_grid->tree();
+  const typename TSectionGrid::ValueType& section_background = section->background();
+  for (auto leaf_iter = section->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    const typename SectionTreeT::LeafNodeType& section_leaf = *leaf_iter;
+    if (carry_values && bbox.isInside(section_leaf.getNodeBoundingBox()))
+    {
+      tree.addLeaf(new LeafT(section_leaf));
+      continue;
+    }
+    if (!carry_values)
+    {
+      if (section_leaf.isEmpty())
+      {
+        continue;
+      }
+      LeafT* leaf                             = tree.touchLeaf(section_leaf.origin());
+      typename LeafT::NodeMaskType value_mask = leaf->getValueMask();
+      value_mask |= section_leaf.getValueMask();
+      leaf->setValueMask(value_mask);
+      continue;
+    }
+    // Inside the bounding box, partially covered leaves take the section values including the
+    // background, just like leaves which are replaced as a whole
+    openvdb::CoordBBox clipped_bbox = section_leaf.getNodeBoundingBox();
+    clipped_bbox.intersect(bbox);
+    LeafT* leaf = tree.touchLeaf(section_leaf.origin());
+    for (auto xyz = clipped_bbox.begin(); xyz; ++xyz)
+    {
+      const openvdb::Index offset = LeafT::coordToOffset(*xyz);
+      leaf->setValueOnly(offset, static_cast<TData>(section_leaf.getValue(offset)));
+      leaf->setActiveState(offset, section_leaf.isValueOn(offset));
+    }
+  }
+
+  // Tiles of the section are applied after all leaves, as filling might densify the map
+  typename SectionTreeT::ValueAllCIter tile_iter = section->tree().cbeginValueAll();
+  tile_iter.setMaxDepth(SectionTreeT::ValueAllCIter::LEAF_DEPTH - 1);
+  for (; tile_iter; ++tile_iter)
+  {
+    openvdb::CoordBBox tile_bbox;
+    tile_iter.getBoundingBox(tile_bbox);
+    if (carry_values && (tile_iter.isValueOn() || *tile_iter != section_background))
+    {
+      tree.fill(tile_bbox, static_cast<TData>(*tile_iter), tile_iter.isValueOn());
+    }
+    else if (!carry_values && tile_iter.isValueOn())
+    {
+      setRegionActiveState(tile_bbox, true);
+    }
+  }
+  if (m_publish_snapshots)
+  {
+    publishSnapshot();
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::setRegionActiveState(const openvdb::CoordBBox& region,
+                                                                   const bool active)
+{
+  // Tiles are collected first and changed afterwards, as filling them changes the tree topology
+  std::vector<std::pair<openvdb::CoordBBox, TData> > tiles;
+  setNodeActiveState(m_vdb_grid->tree().root(), region, region, active, nullptr, tiles);
+  for (const auto& tile : tiles)
+  {
+    m_vdb_grid->tree().fill(tile.first, tile.second, active);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::clearRegion(const openvdb::CoordBBox& region)
+{
+  // Only existing nodes are visited, so in contrast to filling the whole region no nodes are
+  // created in unknown space
+  const TData background = m_vdb_grid->background();
+  std::vector<std::pair<openvdb::CoordBBox, TData> > tiles;
+  setNodeActiveState(m_vdb_grid->tree().root(), region, region, false, &background, tiles);
+  for (const auto& tile : tiles)
+  {
+    m_vdb_grid->tree().fill(tile.first, tile.second, false);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TNode>
+void VDBMapping<TData, TConfig, TTreeLayout>::setNodeActiveState(
+  TNode& node,
+  const openvdb::CoordBBox& node_bbox,
+  const openvdb::CoordBBox& region,
+  const bool active,
+  const TData* value,
+  std::vector<std::pair<openvdb::CoordBBox, TData> >& tiles)
+{
+  using ChildT = typename TNode::ChildNodeType;
+
+  openvdb::CoordBBox clipped_bbox = node_bbox;
+  clipped_bbox.intersect(region);
+  if (clipped_bbox.empty())
+  {
+    return;
+  }
+
+  const openvdb::Int32 child_dim = static_cast<openvdb::Int32>(ChildT::DIM);
+  const openvdb::Coord start     = clipped_bbox.min() & ~(child_dim - 1);
+  openvdb::Coord xyz;
+  for (xyz.x() = start.x(); xyz.x() <= clipped_bbox.max().x(); xyz.x() += child_dim)
+  {
+    for (xyz.y() = start.y(); xyz.y() <= clipped_bbox.max().y(); xyz.y() += child_dim)
+    {
+      for (xyz.z() = start.z(); xyz.z() <= clipped_bbox.max().z(); xyz.z() += child_dim)
+      {
+        const openvdb::CoordBBox child_bbox = openvdb::CoordBBox::createCube(xyz, child_dim);
+        if (ChildT* child = node.template probeNode<ChildT>(xyz))
+        {
+          setNodeActiveState(*child, child_bbox, region, active, value, tiles);
+          continue;
+        }
+
+        TData tile_value;
+        const bool tile_active = node.probeValue(xyz, tile_value);
+        if (tile_active != active || (value && tile_value != *value))
+        {
+          openvdb::CoordBBox tile_bbox = child_bbox;
+          tile_bbox.intersect(region);
+          tiles.emplace_back(tile_bbox, value ? *value : tile_value);
+        }
+      }
+    }
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::setNodeActiveState(
+  typename GridT::TreeType::LeafNodeType& leaf,
+  const openvdb::CoordBBox& leaf_bbox,
+  const openvdb::CoordBBox& region,
+  const bool active,
+  const TData* value,
+  std::vector<std::pair<openvdb::CoordBBox, TData> >& /*tiles*/)
+{
+  if (region.isInside(leaf_bbox))
+  {
+    if (value)
+    {
+      leaf.fill(*value, active);
+    }
+    else if (active)
+    {
+      leaf.setValuesOn();
+    }
+    else
+    {
+      leaf.setValuesOff();
+    }
+    return;
+  }
+
+  openvdb::CoordBBox clipped_bbox = leaf_bbox;
+  clipped_bbox.intersect(region);
+  for (auto xyz = clipped_bbox.begin(); xyz; ++xyz)
+  {
+    if (value)
+    {
+      leaf.setValueOnly(*xyz, *value);
+    }
+    leaf.setActiveState(*xyz, active);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointCloudT::ConstPtr& cloud, const Eigen::Matrix<double, 3, 1>& origin)
+{
+  typename UpdateGridT::Ptr update_grid;
+  typename UpdateGridT::Ptr overwrite_grid;
+
+  return insertPointCloud(cloud, origin, update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointCloudT::ConstPtr& cloud,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  typename UpdateGridT::Ptr& update_grid,
+  typename UpdateGridT::Ptr& overwrite_grid)
+{
+  return insertPointCloud(PointSpan(*cloud), origin, update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points, const Eigen::Matrix<double, 3, 1>& origin)
+{
+  typename UpdateGridT::Ptr update_grid;
+  typename UpdateGridT::Ptr overwrite_grid;
+
+  return insertPointCloud(points, origin, update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  typename UpdateGridT::Ptr& update_grid,
+  typename UpdateGridT::Ptr& overwrite_grid)
+{
+  accumulateUpdate(points, origin, m_max_range);
+  integrateUpdate(update_grid, overwrite_grid);
+  resetUpdate();
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points, const Eigen::Isometry3d& sensor_to_map_tf)
+{
+  typename UpdateGridT::Ptr update_grid;
+  typename UpdateGridT::Ptr overwrite_grid;
+
+  return insertPointCloud(points, sensor_to_map_tf, update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points,
+  const Eigen::Isometry3d& sensor_to_map_tf,
+  typename UpdateGridT::Ptr& update_grid,
+  typename UpdateGridT::Ptr& overwrite_grid)
+{
+  return insertPointCloud(points.transformed(sensor_to_map_tf),
+                          Eigen::Matrix<double, 3, 1>(sensor_to_map_tf.translation()),
+                          update_grid,
+                          overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points, const Eigen::Matrix<double, 4, 4>& sensor_to_map_tf)
+{
+  return insertPointCloud(points, Eigen::Isometry3d(sensor_to_map_tf));
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointCloud(
+  const PointSpan& points,
+  const Eigen::Matrix<double, 4, 4>& sensor_to_map_tf,
+  typename UpdateGridT::Ptr& update_grid,
+  typename UpdateGridT::Ptr& overwrite_grid)
+{
+  return insertPointCloud(
+    points, Eigen::Isometry3d(sensor_to_map_tf), update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointClouds(
+  const std::vector<SensorMeasurement>& measurements)
+{
+  typename UpdateGridT::Ptr update_grid;
+  typename UpdateGridT::Ptr overwrite_grid;
+
+  return insertPointClouds(measurements, update_grid, overwrite_grid);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::insertPointClouds(
+  const std::vector<SensorMeasurement>& measurements,
+  typename UpdateGridT::Ptr& update_grid,
+  typename UpdateGridT::Ptr& overwrite_grid)
+{
+  if (!m_config_set)
+  {
+    std::cerr << "Map not properly configured. Did you call setConfig method?" << std::endl;
+    return false;
+  }
+  accumulateUpdates(measurements);
+  integrateUpdate(update_grid, overwrite_grid);
+  resetUpdate();
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::accumulateUpdates(
+  const std::vector<SensorMeasurement>& measurements)
+{
+  if (measurements.empty())
+  {
+    return;
+  }
+  if (m_tile_voxels > 0)
+  {
+    // The window has to cover all sensors at once, otherwise a sensor could evict the tiles
+    // required by another sensor of the same batch
+    openvdb::BBoxd region;
+    for (const SensorMeasurement& measurement : measurements)
+    {
+      region.expand(measurementRegion(PointSpan(*measurement.cloud),
+                                      measurement.origin,
+                                      measurement.max_range > 0 ? measurement.max_range
+                                                                : m_max_range));
+    }
+    updateTileWindow(region);
+  }
+
+  typename UpdateGridT::Ptr batch_grid = tbb::parallel_reduce(
+    tbb::blocked_range<std::size_t>(0, measurements.size(), 1),
+    typename UpdateGridT::Ptr(),
+    [&](const tbb::blocked_range<std::size_t>& range, typename UpdateGridT::Ptr grid) {
+      if (!grid)
+      {
+        grid = UpdateGridT::create(false);
+      }
+      typename UpdateGridT::Accessor grid_acc = grid->getAccessor();
+      for (std::size_t i = range.begin(); i != range.end(); ++i)
+      {
+        const SensorMeasurement& measurement = measurements[i];
+        raycastPointCloud(measurement.cloud,
+                          measurement.origin,
+                          measurement.max_range > 0 ? measurement.max_range : m_max_range,
+                          grid_acc);
+      }
+      return grid;
+    },
+    [this](const typename UpdateGridT::Ptr& lhs, const typename UpdateGridT::Ptr& rhs) {
+      return joinUpdateGrids(lhs, rhs);
+    });
+
+  typename UpdateGridT::Accessor update_grid_acc = m_update_grid->getAccessor();
+  mergeUpdateGrid(*batch_grid, update_grid_acc);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::accumulateUpdate(
+  const PointCloudT::ConstPtr& cloud,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  const double& max_range)
+{
+  accumulateUpdate(PointSpan(*cloud), origin, max_range);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::accumulateUpdate(
+  const PointSpan& points, const Eigen::Matrix<double, 3, 1>& origin, const double& max_range)
+{
+  if (m_tile_voxels > 0)
+  {
+    updateTileWindow(measurementRegion(points, origin, max_range > 0 ? max_range : m_max_range));
+  }
+  typename UpdateGridT::Accessor update_grid_acc = m_update_grid->getAccessor();
+  if (max_range > 0)
+  {
+    raycastPointCloud(points, origin, max_range, update_grid_acc);
+  }
+  else
+  {
+    raycastPointCloud(points, origin, update_grid_acc);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::publishSnapshot()
+{
+  const std::size_t back      = 1 - m_published_buffer;
+  typename GridT::Ptr& buffer = m_snapshot_buffers[back];
+  if (!buffer || m_snapshot_resync[back])
+  {
+    // A fresh copy never conflicts with readers of the previous buffer
+    buffer                  = m_vdb_grid->deepCopy();
+    m_snapshot_resync[back] = false;
+  }
+  else
+  {
+    // Readers only obtain the published buffer, so the back buffer cannot gain new references
+    if (buffer.use_count() > 1)
+    {
+      return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_snapshot_dirty[back])
+    {
+      const typename UpdateGridT::TreeType& dirty = m_snapshot_dirty[back]->tree();
+      for (auto leaf_iter = dirty.cbeginLeaf(); leaf_iter; ++leaf_iter)
+      {
+        // Empty leaves stem from the unused leaves of recycled update grids
+        if (!leaf_iter->isEmpty())
+        {
+          replicateRegion(*buffer, leaf_iter->getNodeBoundingBox());
+        }
+      }
+      typename UpdateGridT::TreeType::ValueOnCIter tile_iter = dirty.cbeginValueOn();
+      tile_iter.setMaxDepth(UpdateGridT::TreeType::ValueOnCIter::LEAF_DEPTH - 1);
+      for (; tile_iter; ++tile_iter)
+      {
+        openvdb::CoordBBox tile_bbox;
+        tile_iter.getBoundingBox(tile_bbox);
+        replicateRegion(*buffer, tile_bbox);
+      }
+    }
+  }
+  m_snapshot_dirty[back].reset();
+
+  std::atomic_store(&m_snapshot, typename GridT::ConstPtr(buffer));
+  m_published_buffer = back;
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TTree>
+void VDBMapping<TData, TConfig, TTreeLayout>::markMapModified(const TTree& topology)
+{
+  if (!m_paged_grid)
+  {
+    return;
+  }
+  if (!m_modified_region)
+  {
+    m_modified_region = UpdateGridT::create(false);
+  }
+  m_modified_region->tree().topologyUnion(topology);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::markMapModified(const openvdb::CoordBBox& region)
+{
+  if (!m_paged_grid)
+  {
+    return;
+  }
+  if (!m_modified_region)
+  {
+    m_modified_region = UpdateGridT::create(false);
+  }
+  m_modified_region->tree().fill(region, true, true);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TTree>
+void VDBMapping<TData, TConfig, TTreeLayout>::markSnapshotDirty(const TTree& topology)
+{
+  if (!m_publish_snapshots)
+  {
+    return;
+  }
+  for (typename UpdateGridT::Ptr& dirty : m_snapshot_dirty)
+  {
+    if (!dirty)
+    {
+      dirty = UpdateGridT::create(false);
+    }
+    dirty->tree().topologyUnion(topology);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::markSnapshotDirty(const openvdb::CoordBBox& region)
+{
+  if (!m_publish_snapshots)
+  {
+    return;
+  }
+  for (typename UpdateGridT::Ptr& dirty : m_snapshot_dirty)
+  {
+    if (!dirty)
+    {
+      dirty = UpdateGridT::create(false);
+    }
+    dirty->tree().fill(region, true, true);
+  }
 }
 
-template <typename TData, typename TConfig>
-typename VDBMapping<TData, TConfig>::UpdateGridT::Ptr
-VDBMapping<TData, TConfig>::getMapSectionUpdateGrid(
-  const Eigen::Matrix<double, 3, 1>& min_boundary,
-  const Eigen::Matrix<double, 3, 1>& max_boundary,
-  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::markSnapshotResync()
 {
-  return getMapSection<typename VDBMapping<TData, TConfig>::UpdateGridT>(
-    min_boundary, max_boundary, map_to_reference_tf);
+  m_snapshot_resync.fill(true);
+  for (typename UpdateGridT::Ptr& dirty : m_snapshot_dirty)
+  {
+    dirty.reset();
+  }
+  if (m_publish_snapshots)
+  {
+    publishSnapshot();
+  }
 }
 
-template <typename TData, typename TConfig>
-typename VDBMapping<TData, TConfig>::GridT::Ptr VDBMapping<TData, TConfig>::getMapSectionGrid(
-  const Eigen::Matrix<double, 3, 1>& min_boundary,
-  const Eigen::Matrix<double, 3, 1>& max_boundary,
-  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::replicateRegion(
+  GridT& buffer, const openvdb::CoordBBox& region) const
 {
-  return getMapSection<typename VDBMapping<TData, TConfig>::GridT>(
-    min_boundary, max_boundary, map_to_reference_tf);
+  buffer.tree().fill(region, buffer.background(), false);
+  copySectionNode(m_vdb_grid->tree().root(), region, region, true, buffer.tree());
 }
 
-template <typename TData, typename TConfig>
-template <typename TResultGrid>
-typename TResultGrid::Ptr VDBMapping<TData, TConfig>::getMapSection(
-  const Eigen::Matrix<double, 3, 1>& min_boundary,
-  const Eigen::Matrix<double, 3, 1>& max_boundary,
-  const Eigen::Matrix<double, 4, 4>& map_to_reference_tf) const
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::BBoxd VDBMapping<TData, TConfig, TTreeLayout>::measurementRegion(
+  const PointSpan& points,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  const double max_range) const
 {
-  typename TResultGrid::Ptr temp_grid = TResultGrid::create(false);
-  temp_grid->setTransform(openvdb::math::Transform::createLinearTransform(m_resolution));
+  openvdb::Vec3d min(origin.x(), origin.y(), origin.z());
+  openvdb::Vec3d max = min;
+  if (max_range > 0.0)
+  {
+    min -= openvdb::Vec3d(max_range);
+    max += openvdb::Vec3d(max_range);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+      const openvdb::Vec3d point = points[i];
+      if (point.isFinite())
+      {
+        min = openvdb::math::minComponent(min, point);
+        max = openvdb::math::maxComponent(max, point);
+      }
+    }
+  }
+  return openvdb::BBoxd(min, max);
+}
 
-  typename TResultGrid::Accessor temp_acc = temp_grid->getAccessor();
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::updateTileWindow(const openvdb::BBoxd& region)
+{
+  const openvdb::Coord needed_min = openvdb::Coord::floor(
+    m_vdb_grid->worldToIndex(region.min()) / static_cast<double>(m_tile_voxels));
+  const openvdb::Coord needed_max = openvdb::Coord::floor(
+    m_vdb_grid->worldToIndex(region.max()) / static_cast<double>(m_tile_voxels));
+  const openvdb::CoordBBox needed_tiles(needed_min, needed_max);
+  openvdb::CoordBBox window_tiles = needed_tiles;
+  window_tiles.expand(static_cast<openvdb::Int32>(m_tile_margin));
 
-  openvdb::CoordBBox bounding_box(
-    createIndexBoundingBox(min_boundary, max_boundary, map_to_reference_tf));
+  std::vector<openvdb::Coord> evicted_tiles;
+  for (const openvdb::Coord& tile : m_resident_tiles)
+  {
+    if (!window_tiles.isInside(tile))
+    {
+      evicted_tiles.push_back(tile);
+    }
+  }
+  for (const openvdb::Coord& tile : evicted_tiles)
+  {
+    evictTile(tile);
+  }
 
-  for (auto iter = m_vdb_grid->cbeginValueOn(); iter; ++iter)
+  for (auto tile = window_tiles.begin(); tile; ++tile)
   {
-    if (bounding_box.isInside(iter.getCoord()))
+    if (m_resident_tiles.count(*tile) > 0)
+    {
+      continue;
+    }
+    auto load = m_tile_loads.find(*tile);
+    if (load == m_tile_loads.end())
+    {
+      requestTile(*tile);
+      load = m_tile_loads.find(*tile);
+    }
+    // Tiles which can be modified have to be complete, prefetched tiles are merged once loaded
+    if (load != m_tile_loads.end() &&
+        (needed_tiles.isInside(*tile) ||
+         load->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
     {
-      temp_acc.setValueOn(iter.getCoord(), true);
+      finishTileLoad(*tile);
     }
   }
 
-  openvdb::Vec3d min(bounding_box.min().x(), bounding_box.min().y(), bounding_box.min().z());
-  openvdb::Vec3d max(bounding_box.max().x(), bounding_box.max().y(), bounding_box.max().z());
-  temp_grid->insertMeta("bb_min", openvdb::Vec3DMetadata(min));
-  temp_grid->insertMeta("bb_max", openvdb::Vec3DMetadata(max));
-  return temp_grid;
+  // Loads of tiles which left the window before they were needed are discarded once they finished,
+  // as destroying a pending future would block until then
+  for (auto load = m_tile_loads.begin(); load != m_tile_loads.end();)
+  {
+    if (!window_tiles.isInside(load->first))
+    {
+      m_discarded_tile_loads.push_back(std::move(load->second));
+      load = m_tile_loads.erase(load);
+    }
+    else
+    {
+      ++load;
+    }
+  }
+  m_discarded_tile_loads.erase(
+    std::remove_if(m_discarded_tile_loads.begin(),
+                   m_discarded_tile_loads.end(),
+                   [](const std::future<typename GridT::Ptr>& load) {
+                     return load.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                   }),
+    m_discarded_tile_loads.end());
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::applyMapSectionGrid(
-  const typename VDBMapping<TData, TConfig>::GridT::Ptr section)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::evictTile(const openvdb::Coord& tile)
 {
-  applyMapSection<typename VDBMapping<TData, TConfig>::GridT>(section);
+  const openvdb::CoordBBox bbox = tileBoundingBox(tile);
+  typename GridT::Ptr tile_grid = GridT::create(m_vdb_grid->background());
+  tile_grid->setTransform(m_vdb_grid->transform().copy());
+  copySectionNode(m_vdb_grid->tree().root(), bbox, bbox, true, tile_grid->tree());
+  m_vdb_grid->tree().fill(bbox, m_vdb_grid->background(), false);
+  m_resident_tiles.erase(tile);
+  markSnapshotDirty(bbox);
+
+  const std::string file_path = tilePath(tile);
+  if (tile_grid->empty())
+  {
+    std::remove(file_path.c_str());
+    return;
+  }
+  // A previous write of the same tile finishes before the new one is started
+  m_tile_writes[tile] = std::async(std::launch::async, [tile_grid, file_path]() {
+    return writeGridFile(tile_grid, file_path);
+  });
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::applyMapSectionUpdateGrid(
-  const typename VDBMapping<TData, TConfig>::UpdateGridT::Ptr section)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::requestTile(const openvdb::Coord& tile)
 {
-  applyMapSection<typename VDBMapping<TData, TConfig>::UpdateGridT>(section);
+  auto write = m_tile_writes.find(tile);
+  if (write != m_tile_writes.end())
+  {
+    write->second.wait();
+    m_tile_writes.erase(write);
+  }
+  const std::string file_path = tilePath(tile);
+  if (!std::ifstream(file_path).good())
+  {
+    m_resident_tiles.insert(tile);
+    return;
+  }
+  m_tile_loads[tile] = std::async(std::launch::async, [file_path]() {
+    // The leaf buffers are read right away, so the mapping thread never waits for the disk
+    openvdb::io::File file_handle(file_path);
+    file_handle.open(false);
+    openvdb::GridBase::Ptr base_grid = file_handle.readGrid(file_handle.beginName().gridName());
+    file_handle.close();
+    return openvdb::gridPtrCast<GridT>(base_grid);
+  });
 }
 
-template <typename TData, typename TConfig>
-template <typename TSectionGrid>
-void VDBMapping<TData, TConfig>::applyMapSection(typename TSectionGrid::Ptr section)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::finishTileLoad(const openvdb::Coord& tile)
 {
-  typename TSectionGrid::Accessor section_acc = section->getAccessor();
-  typename GridT::Accessor acc                = m_vdb_grid->getAccessor();
+  auto load = m_tile_loads.find(tile);
+  if (load == m_tile_loads.end())
+  {
+    return;
+  }
+  typename GridT::Ptr tile_grid;
+  try
+  {
+    tile_grid = load->second.get();
+  }
+  catch (const openvdb::Exception& e)
+  {
+    std::cerr << "Loading tile " << tilePath(tile) << " failed: " << e.what() << std::endl;
+  }
+  m_tile_loads.erase(load);
+  if (tile_grid)
+  {
+    // The merge ignores inactive tiles wherever it descends into a node shared with a neighbouring
+    // tile, so inactive tiles carrying a value, e.g. pruned free space, are restored separately
+    std::vector<std::pair<openvdb::CoordBBox, TData> > inactive_tiles;
+    const TData& background = m_vdb_grid->background();
+    typename GridT::TreeType::ValueOffCIter tile_iter = tile_grid->tree().cbeginValueOff();
+    tile_iter.setMaxDepth(GridT::TreeType::ValueOffCIter::LEAF_DEPTH - 1);
+    for (; tile_iter; ++tile_iter)
+    {
+      if (*tile_iter != background)
+      {
+        inactive_tiles.emplace_back(tile_iter.getBoundingBox(), *tile_iter);
+      }
+    }
 
-  openvdb::Vec3d min = section->template metaValue<openvdb::Vec3d>("bb_min");
-  openvdb::Vec3d max = section->template metaValue<openvdb::Vec3d>("bb_max");
-  openvdb::CoordBBox bbox(openvdb::Coord::floor(min), openvdb::Coord::floor(max));
+    // The tile region of the map is empty, so the nodes of the tile are transferred as a whole
+    m_vdb_grid->tree().merge(tile_grid->tree(), openvdb::MERGE_ACTIVE_STATES_AND_NODES);
+    for (const auto& inactive_tile : inactive_tiles)
+    {
+      m_vdb_grid->tree().fill(inactive_tile.first, inactive_tile.second, false);
+    }
+    markMapModified(tileBoundingBox(tile));
+    markSnapshotDirty(tileBoundingBox(tile));
+  }
+  m_resident_tiles.insert(tile);
+}
 
-  for (auto iter = m_vdb_grid->cbeginValueOn(); iter; ++iter)
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::storeResidentTiles()
+{
+  bool success = true;
+  for (const openvdb::Coord& tile : m_resident_tiles)
   {
-    if (bbox.isInside(iter.getCoord()))
+    const openvdb::CoordBBox bbox = tileBoundingBox(tile);
+    typename GridT::Ptr tile_grid = GridT::create(m_vdb_grid->background());
+    tile_grid->setTransform(m_vdb_grid->transform().copy());
+    copySectionNode(m_vdb_grid->tree().root(), bbox, bbox, true, tile_grid->tree());
+    if (!tile_grid->empty())
     {
-      acc.setActiveState(iter.getCoord(), false);
+      success &= writeGridFile(tile_grid, tilePath(tile));
     }
   }
-  for (auto iter = section->cbeginValueOn(); iter; ++iter)
+  for (auto& write : m_tile_writes)
   {
-    acc.setActiveState(iter.getCoord(), true);
+    success &= write.second.get();
   }
+  m_tile_writes.clear();
+  return success;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::CoordBBox VDBMapping<TData, TConfig, TTreeLayout>::tileBoundingBox(
+  const openvdb::Coord& tile) const
+{
+  const openvdb::Coord min(
+    tile.x() * m_tile_voxels, tile.y() * m_tile_voxels, tile.z() * m_tile_voxels);
+  return openvdb::CoordBBox(min, min.offsetBy(m_tile_voxels - 1));
 }
 
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::string VDBMapping<TData, TConfig, TTreeLayout>::tilePath(const openvdb::Coord& tile) const
+{
+  return m_map_directory_path + "tile_" + std::to_string(tile.x()) + "_" +
+         std::to_string(tile.y()) + "_" + std::to_string(tile.z()) + ".vdb";
+}
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::insertPointCloud(const PointCloudT::ConstPtr& cloud,
-                                                  const Eigen::Matrix<double, 3, 1>& origin)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::integrateUpdate(
+  typename UpdateGridT::Ptr& update_grid, typename UpdateGridT::Ptr& overwrite_grid)
 {
-  UpdateGridT::Ptr update_grid;
-  UpdateGridT::Ptr overwrite_grid;
+  overwrite_grid = integrateUpdate(m_update_grid);
+  update_grid    = m_update_grid;
+}
 
-  return insertPointCloud(cloud, origin, update_grid, overwrite_grid);
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::integrateUpdate(
+  const typename UpdateGridT::Ptr& update_grid)
+{
+  typename UpdateGridT::Ptr overwrite_grid = updateMap(update_grid);
+  appendJournalEntry(JournalEntryType::UPDATE, update_grid);
+  if (m_publish_snapshots)
+  {
+    publishSnapshot();
+  }
+  return overwrite_grid;
 }
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::insertPointCloud(const PointCloudT::ConstPtr& cloud,
-                                                  const Eigen::Matrix<double, 3, 1>& origin,
-                                                  UpdateGridT::Ptr& update_grid,
-                                                  UpdateGridT::Ptr& overwrite_grid)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::resetUpdate()
 {
-  accumulateUpdate(cloud, origin, m_max_range);
-  integrateUpdate(update_grid, overwrite_grid);
-  resetUpdate();
-  return true;
+  recycleUpdateGrid(m_update_grid, m_spare_update_grid);
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::accumulateUpdate(const PointCloudT::ConstPtr& cloud,
-                                                  const Eigen::Matrix<double, 3, 1>& origin,
-                                                  const double& max_range)
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::recycleUpdateGrid(typename UpdateGridT::Ptr& grid,
+                                                           typename UpdateGridT::Ptr& spare)
 {
-  UpdateGridT::Accessor update_grid_acc = m_update_grid->getAccessor();
-  if (max_range > 0)
+  std::swap(grid, spare);
+  if (!grid || grid.use_count() > 1)
   {
-    raycastPointCloud(cloud, origin, max_range, update_grid_acc);
+    grid = UpdateGridT::create(false);
+    return grid;
   }
-  else
+  // The last outside reference might have been dropped by another thread, whose accesses to the
+  // grid have to happen before it is reset
+  std::atomic_thread_fence(std::memory_order_acquire);
+  openvdb::tools::pruneInactive(grid->tree());
+  for (auto leaf_iter = grid->tree().beginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    leaf_iter->fill(false, false);
+  }
+  typename UpdateGridT::TreeType::ValueOnIter tile_iter = grid->tree().beginValueOn();
+  tile_iter.setMaxDepth(UpdateGridT::TreeType::ValueOnIter::LEAF_DEPTH - 1);
+  for (; tile_iter; ++tile_iter)
   {
-    raycastPointCloud(cloud, origin, update_grid_acc);
+    tile_iter.setValue(false);
+    tile_iter.setValueOff();
   }
+  return grid;
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::integrateUpdate(UpdateGridT::Ptr& update_grid,
-                                                 UpdateGridT::Ptr& overwrite_grid)
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raycastPointCloud(
+  const PointCloudT::ConstPtr& cloud,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  typename UpdateGridT::Accessor& update_grid_acc)
 {
-  overwrite_grid = updateMap(m_update_grid);
-  update_grid    = m_update_grid;
+  return raycastPointCloud(PointSpan(*cloud), origin, m_max_range, update_grid_acc);
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::resetUpdate()
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raycastPointCloud(
+  const PointCloudT::ConstPtr& cloud,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  const double raycast_range,
+  typename UpdateGridT::Accessor& update_grid_acc)
 {
-  m_update_grid = UpdateGridT::create(false);
+  return raycastPointCloud(PointSpan(*cloud), origin, raycast_range, update_grid_acc);
 }
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::raycastPointCloud(const PointCloudT::ConstPtr& cloud,
-                                                   const Eigen::Matrix<double, 3, 1>& origin,
-                                                   UpdateGridT::Accessor& update_grid_acc)
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raycastPointCloud(
+  const PointSpan& points,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  typename UpdateGridT::Accessor& update_grid_acc)
 {
-  return raycastPointCloud(cloud, origin, m_max_range, update_grid_acc);
+  return raycastPointCloud(points, origin, m_max_range, update_grid_acc);
 }
 
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::raycastPointCloud(const PointCloudT::ConstPtr& cloud,
-                                                   const Eigen::Matrix<double, 3, 1>& origin,
-                                                   const double raycast_range,
-                                                   UpdateGridT::Accessor& update_grid_acc)
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raycastPointCloud(
+  const PointSpan& points,
+  const Eigen::Matrix<double, 3, 1>& origin,
+  const double raycast_range,
+  typename UpdateGridT::Accessor& update_grid_acc)
 {
   // Creating a temporary grid in which the new data is casted. This way we prevent the computation
   // of redundant probability updates in the actual map
@@ -329,55 +1712,169 @@ bool VDBMapping<TData, TConfig>::raycastPointCloud(const PointCloudT::ConstPtr&
     return false;
   }
 
-  RayT ray;
-  DDAT dda;
-
   // Ray origin in world coordinates
   openvdb::Vec3d ray_origin_world(origin.x(), origin.y(), origin.z());
   // Ray origin in index coordinates
   Vec3T ray_origin_index(m_vdb_grid->worldToIndex(ray_origin_world));
-  // Ray end point in world coordinates
-  openvdb::Vec3d ray_end_world;
+
+  // The points are read directly from the input buffer, with deduplication only the selected ones
+  std::vector<std::size_t> selected;
+  if (m_deduplicate_endpoints)
+  {
+    selected = uniqueEndPoints(points, ray_origin_world, raycast_range);
+  }
+  const std::size_t num_rays = m_deduplicate_endpoints ? selected.size() : points.size();
+
+  auto ray_end = [&](const std::size_t i) {
+    return points[m_deduplicate_endpoints ? selected[i] : i];
+  };
+
+  if (m_parallel_raycasting)
+  {
+    // Each worker raycasts a chunk of the cloud into its own update grid. Since marking a voxel is
+    // order independent, merging the partial grids yields the same result as the serial loop.
+    typename UpdateGridT::Ptr cloud_grid = tbb::parallel_reduce(
+      tbb::blocked_range<std::size_t>(0, num_rays, 256),
+      typename UpdateGridT::Ptr(),
+      [&](const tbb::blocked_range<std::size_t>& range, typename UpdateGridT::Ptr grid) {
+        if (!grid)
+        {
+          grid = UpdateGridT::create(false);
+        }
+        typename UpdateGridT::Accessor grid_acc = grid->getAccessor();
+        for (std::size_t i = range.begin(); i != range.end(); ++i)
+        {
+          raycastPoint(ray_origin_world, ray_origin_index, ray_end(i), raycast_range, grid_acc);
+        }
+        return grid;
+      },
+      [this](const typename UpdateGridT::Ptr& lhs, const typename UpdateGridT::Ptr& rhs) {
+        return joinUpdateGrids(lhs, rhs);
+      });
+
+    if (cloud_grid)
+    {
+      mergeUpdateGrid(*cloud_grid, update_grid_acc);
+    }
+    return true;
+  }
 
   // Raycasting of every point in the input cloud
-  for (const PointT& pt : *cloud)
+  for (std::size_t i = 0; i < num_rays; ++i)
   {
-    ray_end_world      = openvdb::Vec3d(pt.x, pt.y, pt.z);
-    bool max_range_ray = false;
+    raycastPoint(ray_origin_world, ray_origin_index, ray_end(i), raycast_range, update_grid_acc);
+  }
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raycastPointCloud(
+  const PointSpan& points,
+  const Eigen::Isometry3d& sensor_to_map_tf,
+  const double raycast_range,
+  typename UpdateGridT::Accessor& update_grid_acc)
+{
+  return raycastPointCloud(points.transformed(sensor_to_map_tf),
+                           Eigen::Matrix<double, 3, 1>(sensor_to_map_tf.translation()),
+                           raycast_range,
+                           update_grid_acc);
+}
 
+template <typename TData, typename TConfig, typename TTreeLayout>
+std::vector<std::size_t>
+VDBMapping<TData, TConfig, TTreeLayout>::uniqueEndPoints(const PointSpan& points,
+                                                         const openvdb::Vec3d& ray_origin_world,
+                                                         const double raycast_range) const
+{
+  std::vector<std::size_t> selected;
+  selected.reserve(points.size());
+
+  // Voxel sets of all end voxels seen so far, keyed by the voxel raycastPoint marks as hit
+  typename UpdateGridT::Ptr hit_ends                = UpdateGridT::create(false);
+  typename UpdateGridT::Ptr max_range_ends          = UpdateGridT::create(false);
+  typename UpdateGridT::Accessor hit_ends_acc       = hit_ends->getAccessor();
+  typename UpdateGridT::Accessor max_range_ends_acc = max_range_ends->getAccessor();
+  for (std::size_t i = 0; i < points.size(); ++i)
+  {
+    const openvdb::Vec3d ray_end_world       = points[i];
+    openvdb::Vec3d clipped_end_world         = ray_end_world;
+    typename UpdateGridT::Accessor* ends_acc = &hit_ends_acc;
     if (raycast_range > 0.0 && (ray_end_world - ray_origin_world).length() > raycast_range)
     {
-      ray_end_world = ray_origin_world + (ray_end_world - ray_origin_world).unit() * raycast_range;
-      max_range_ray = true;
+      clipped_end_world =
+        ray_origin_world + (ray_end_world - ray_origin_world).unit() * raycast_range;
+      ends_acc = &max_range_ends_acc;
     }
-    openvdb::Coord ray_end_index = openvdb::Coord::round(m_vdb_grid->worldToIndex(ray_end_world));
-    
-    if (!m_static_env)
+    const openvdb::Coord end_index = rayEndIndex(ray_origin_world, clipped_end_world);
+    if (ends_acc->isValueOn(end_index))
     {
-      ray_end_index = castRayIntoGrid(ray_origin_world, ray_origin_index, ray_end_world, update_grid_acc);
+      continue;
     }
+    ends_acc->setValueOn(end_index);
+    selected.push_back(i);
+  }
+  return selected;
+}
 
-    if (!max_range_ray)
-    {
-      update_grid_acc.setValueOn(ray_end_index, true);
-    }
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::raycastPoint(
+  const openvdb::Vec3d& ray_origin_world,
+  const Vec3T& ray_origin_index,
+  openvdb::Vec3d ray_end_world,
+  const double raycast_range,
+  typename UpdateGridT::Accessor& update_grid_acc) const
+{
+  bool max_range_ray = false;
+
+  if (raycast_range > 0.0 && (ray_end_world - ray_origin_world).length() > raycast_range)
+  {
+    ray_end_world = ray_origin_world + (ray_end_world - ray_origin_world).unit() * raycast_range;
+    max_range_ray = true;
+  }
+  openvdb::Coord ray_end_index = openvdb::Coord::round(m_vdb_grid->worldToIndex(ray_end_world));
+
+  if (!m_static_env)
+  {
+    ray_end_index =
+      castRayIntoGrid(ray_origin_world, ray_origin_index, ray_end_world, update_grid_acc);
+  }
+
+  if (!max_range_ray)
+  {
+    update_grid_acc.setValueOn(ray_end_index, true);
   }
-  return true;
 }
 
-template <typename TData, typename TConfig>
-openvdb::Coord
-VDBMapping<TData, TConfig>::castRayIntoGrid(const openvdb::Vec3d& ray_origin_world,
-                                            const Vec3T& ray_origin_index,
-                                            const openvdb::Vec3d& ray_end_world,
-                                            UpdateGridT::Accessor& update_grid_acc) const
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::mergeUpdateGrid(
+  const UpdateGridT& source, typename UpdateGridT::Accessor& target_acc) const
 {
-  openvdb::Vec3d sign = ray_end_world - ray_origin_world;
+  using NodeMaskType = typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType;
 
-  // lambda function to map a value to 0 if abs(value) < m_resolution, elif value>0 to 1 and elif value<0 to -1
-  auto signum = [&](double val) { return val < -m_resolution ? -1 : val > m_resolution ? 1 : 0; };
+  for (auto leaf_iter = source.tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    if (leaf_iter->isEmpty())
+    {
+      continue;
+    }
+    typename UpdateGridT::TreeType::LeafNodeType* target_leaf =
+      target_acc.touchLeaf(leaf_iter->origin());
+    NodeMaskType update_mask = target_leaf->getValueMask();
+    NodeMaskType hit_mask    = hitMask(*target_leaf);
+    update_mask |= leaf_iter->getValueMask();
+    hit_mask |= hitMask(*leaf_iter);
+    setUpdateLeaf(*target_leaf, update_mask, hit_mask);
+  }
+}
 
-  sign = openvdb::Vec3d(signum(sign.x()), signum(sign.y()), signum(sign.z()));
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::Coord VDBMapping<TData, TConfig, TTreeLayout>::castRayIntoGrid(
+  const openvdb::Vec3d& ray_origin_world,
+  const Vec3T& ray_origin_index,
+  const openvdb::Vec3d& ray_end_world,
+  typename UpdateGridT::Accessor& update_grid_acc) const
+{
+  const openvdb::Vec3d sign = raySign(ray_origin_world, ray_end_world);
 
   openvdb::Vec3d ray_end_world_corrected = ray_end_world - sign * openvdb::Vec3d(m_resolution, m_resolution, m_resolution);
 
@@ -396,55 +1893,170 @@ VDBMapping<TData, TConfig>::castRayIntoGrid(const openvdb::Vec3d& ray_origin_wor
   return dda.voxel() + openvdb::Coord::round(sign);
 }
 
-template <typename TData, typename TConfig>
-bool VDBMapping<TData, TConfig>::raytrace(const openvdb::Vec3d& ray_origin_world,
-                                          const openvdb::Vec3d& ray_direction,
-                                          const double max_ray_length,
-                                          openvdb::Vec3d& end_point)
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::Vec3d
+VDBMapping<TData, TConfig, TTreeLayout>::raySign(const openvdb::Vec3d& ray_origin_world,
+                                                 const openvdb::Vec3d& ray_end_world) const
+{
+  const openvdb::Vec3d direction = ray_end_world - ray_origin_world;
+
+  // lambda function to map a value to 0 if abs(value) < m_resolution, elif value>0 to 1 and elif
+  // value<0 to -1
+  auto signum = [&](double val) { return val < -m_resolution ? -1 : val > m_resolution ? 1 : 0; };
+
+  return openvdb::Vec3d(signum(direction.x()), signum(direction.y()), signum(direction.z()));
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+openvdb::Coord
+VDBMapping<TData, TConfig, TTreeLayout>::rayEndIndex(const openvdb::Vec3d& ray_origin_world,
+                                                     const openvdb::Vec3d& ray_end_world) const
+{
+  if (m_static_env)
+  {
+    return openvdb::Coord::round(m_vdb_grid->worldToIndex(ray_end_world));
+  }
+  // castRayIntoGrid traverses up to the end point moved back by one voxel and returns the voxel
+  // one step further along the sign
+  const openvdb::Vec3d sign = raySign(ray_origin_world, ray_end_world);
+  const openvdb::Vec3d ray_end_world_corrected =
+    ray_end_world - sign * openvdb::Vec3d(m_resolution, m_resolution, m_resolution);
+  return openvdb::Coord::floor(m_vdb_grid->worldToIndex(ray_end_world_corrected)) +
+         openvdb::Coord::round(sign);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::joinUpdateGrids(const typename UpdateGridT::Ptr& lhs,
+                                                         const typename UpdateGridT::Ptr& rhs) const
+{
+  if (!lhs)
+  {
+    return rhs;
+  }
+  if (rhs)
+  {
+    typename UpdateGridT::Accessor lhs_acc = lhs->getAccessor();
+    mergeUpdateGrid(*rhs, lhs_acc);
+  }
+  return lhs;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::raytrace(const openvdb::Vec3d& ray_origin_world,
+                                                       const openvdb::Vec3d& ray_direction,
+                                                       const double max_ray_length,
+                                                       openvdb::Vec3d& end_point) const
 {
-  typename GridT::Accessor acc    = m_vdb_grid->getAccessor();
+  double distance;
+  return traceRay(m_vdb_grid->getConstAccessor(),
+                  ray_origin_world,
+                  ray_direction,
+                  max_ray_length,
+                  end_point,
+                  distance);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::raytraceBatch(const openvdb::Vec3d* ray_origins_world,
+                                                            const openvdb::Vec3d* ray_directions,
+                                                            const std::size_t ray_count,
+                                                            const double max_ray_length,
+                                                            openvdb::Vec3d* end_points,
+                                                            double* distances,
+                                                            bool* hits) const
+{
+  tbb::enumerable_thread_specific<typename GridT::ConstAccessor> accessors(
+    m_vdb_grid->getConstAccessor());
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, ray_count, 256),
+                    [&](const tbb::blocked_range<std::size_t>& range) {
+                      const typename GridT::ConstAccessor& acc = accessors.local();
+                      for (std::size_t i = range.begin(); i < range.end(); ++i)
+                      {
+                        hits[i] = traceRay(acc,
+                                           ray_origins_world[i],
+                                           ray_directions[i],
+                                           max_ray_length,
+                                           end_points[i],
+                                           distances[i]);
+                      }
+                    });
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+bool VDBMapping<TData, TConfig, TTreeLayout>::traceRay(const typename GridT::ConstAccessor& acc,
+                                                       const openvdb::Vec3d& ray_origin_world,
+                                                       const openvdb::Vec3d& ray_direction,
+                                                       const double max_ray_length,
+                                                       openvdb::Vec3d& end_point,
+                                                       double& distance) const
+{
+  if (ray_direction.lengthSqr() <= 0.0 || max_ray_length <= 0.0)
+  {
+    return false;
+  }
   openvdb::Vec3d ray_origin_index = m_vdb_grid->worldToIndex(ray_origin_world);
-  RayT ray(ray_origin_index, ray_direction);
-  DDAT dda(ray);
-  while (true)
+  // The direction is normalized, so ray times are distances in voxels
+  RayT ray(ray_origin_index, ray_direction.unit(), 0.0, max_ray_length / m_resolution);
+
+  HDDAT hdda;
+  openvdb::Coord hit;
+  double time;
+  if (!hdda.march(ray, acc, hit, time))
   {
-    double distance =
-      m_resolution * std::sqrt(std::pow((dda.voxel().x() - ray_origin_index.x()), 2) +
-                               std::pow((dda.voxel().y() - ray_origin_index.y()), 2) +
-                               std::pow((dda.voxel().z() - ray_origin_index.z()), 2));
-    if (distance < max_ray_length)
-    {
-      if (acc.isValueOn(dda.voxel()))
-      {
-        end_point = m_vdb_grid->indexToWorld(dda.voxel());
-        return true;
-      }
-      dda.step();
-    }
-    else
-    {
-      return false;
-    }
+    return false;
   }
+  end_point = m_vdb_grid->indexToWorld(hit);
+  distance  = time * m_resolution;
+  return true;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::updateMap(const typename UpdateGridT::Ptr& temp_grid)
+{
+  return updateMapWithPolicy(temp_grid, VirtualUpdatePolicy(this));
 }
 
-template <typename TData, typename TConfig>
-VDBMapping<TData, TConfig>::UpdateGridT::Ptr
-VDBMapping<TData, TConfig>::updateMap(const UpdateGridT::Ptr& temp_grid)
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TUpdatePolicy>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::updateMapWithPolicy(
+  const typename UpdateGridT::Ptr& temp_grid, const TUpdatePolicy& policy)
 {
-  UpdateGridT::Ptr change          = UpdateGridT::create(false);
-  UpdateGridT::Accessor change_acc = change->getAccessor();
   if (temp_grid->empty())
   {
+    return UpdateGridT::create(false);
+  }
+  markMapModified(temp_grid->tree());
+  markSnapshotDirty(temp_grid->tree());
+  const bool leaves_only = temp_grid->tree().activeTileCount() == 0;
+  if (m_parallel_integration && leaves_only)
+  {
+    return updateMapParallel(temp_grid, policy);
+  }
+  typename UpdateGridT::Ptr change          = recycleUpdateGrid(m_change_grid, m_spare_change_grid);
+  typename UpdateGridT::Accessor change_acc = change->getAccessor();
+  typename GridT::Accessor acc              = m_vdb_grid->getAccessor();
+
+  if (leaves_only)
+  {
+    // All updates are stored in leaves, so each leaf is integrated on its masks as a whole
+    for (auto leaf_iter = temp_grid->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+    {
+      if (!leaf_iter->isEmpty())
+      {
+        integrateUpdateLeaf(*leaf_iter, *acc.touchLeaf(leaf_iter->origin()), policy, change_acc);
+      }
+    }
     return change;
   }
 
-  bool state_changed           = false;
-  typename GridT::Accessor acc = m_vdb_grid->getAccessor();
+  bool state_changed = false;
   // Probability update lambda for free space grid elements
   auto miss = [&](TData& voxel_value, bool& active) {
     bool last_state = active;
-    updateFreeNode(voxel_value, active);
+    policy.updateFreeNode(voxel_value, active);
     if (last_state != active)
     {
       state_changed = true;
@@ -454,7 +2066,7 @@ VDBMapping<TData, TConfig>::updateMap(const UpdateGridT::Ptr& temp_grid)
   // Probability update lambda for occupied grid elements
   auto hit = [&](TData& voxel_value, bool& active) {
     bool last_state = active;
-    updateOccupiedNode(voxel_value, active);
+    policy.updateOccupiedNode(voxel_value, active);
     if (last_state != active)
     {
       state_changed = true;
@@ -462,7 +2074,7 @@ VDBMapping<TData, TConfig>::updateMap(const UpdateGridT::Ptr& temp_grid)
   };
 
   // Integrating the data of the temporary grid into the map using the probability update functions
-  for (UpdateGridT::ValueOnCIter iter = temp_grid->cbeginValueOn(); iter; ++iter)
+  for (typename UpdateGridT::ValueOnCIter iter = temp_grid->cbeginValueOn(); iter; ++iter)
   {
     state_changed = false;
     if (*iter)
@@ -485,11 +2097,133 @@ VDBMapping<TData, TConfig>::updateMap(const UpdateGridT::Ptr& temp_grid)
   return change;
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::overwriteMap(const UpdateGridT::Ptr& update_grid)
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TUpdatePolicy>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::Ptr
+VDBMapping<TData, TConfig, TTreeLayout>::updateMapParallel(
+  const typename UpdateGridT::Ptr& temp_grid, const TUpdatePolicy& policy)
+{
+  using UpdateLeafT  = typename UpdateGridT::TreeType::LeafNodeType;
+  using LeafT        = typename GridT::TreeType::LeafNodeType;
+  using NodeMaskType = typename UpdateLeafT::NodeMaskType;
+
+  // Creating the map topology up front, so that the parallel workers never modify the tree
+  // structure itself
+  std::vector<std::pair<const UpdateLeafT*, LeafT*> > leaves;
+  leaves.reserve(temp_grid->tree().leafCount());
+  typename GridT::Accessor acc = m_vdb_grid->getAccessor();
+  for (auto leaf_iter = temp_grid->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    // Like the serial integration, empty update leaves must not create map leaves
+    if (!leaf_iter->isEmpty())
+    {
+      leaves.emplace_back(leaf_iter.getLeaf(), acc.touchLeaf(leaf_iter->origin()));
+    }
+  }
+
+  // The change masks of each leaf are stored in its own slot, so the workers share no grid
+  std::vector<std::pair<NodeMaskType, NodeMaskType> > changes(leaves.size());
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, leaves.size()),
+                    [&](const tbb::blocked_range<std::size_t>& range) {
+                      for (std::size_t i = range.begin(); i != range.end(); ++i)
+                      {
+                        integrateUpdateLeaf(*leaves[i].first,
+                                            *leaves[i].second,
+                                            policy,
+                                            changes[i].first,
+                                            changes[i].second);
+                      }
+                    });
+
+  typename UpdateGridT::Ptr change          = recycleUpdateGrid(m_change_grid, m_spare_change_grid);
+  typename UpdateGridT::Accessor change_acc = change->getAccessor();
+  for (std::size_t i = 0; i < leaves.size(); ++i)
+  {
+    if (!changes[i].first.isOff())
+    {
+      setUpdateLeaf(
+        *change_acc.touchLeaf(leaves[i].first->origin()), changes[i].first, changes[i].second);
+    }
+  }
+  return change;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+typename VDBMapping<TData, TConfig, TTreeLayout>::UpdateGridT::TreeType::LeafNodeType::NodeMaskType
+VDBMapping<TData, TConfig, TTreeLayout>::hitMask(
+  const typename UpdateGridT::TreeType::LeafNodeType& update_leaf) const
+{
+  using NodeMaskType = typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType;
+  using Word         = typename NodeMaskType::Word;
+
+  // The values of a boolean leaf are stored as a bit mask as well
+  const NodeMaskType& update_mask = update_leaf.getValueMask();
+  const Word* values              = update_leaf.buffer().data();
+  NodeMaskType hit_mask;
+  for (openvdb::Index i = 0; i < NodeMaskType::WORD_COUNT; ++i)
+  {
+    hit_mask.template getWord<Word>(i) = values[i] & update_mask.template getWord<Word>(i);
+  }
+  return hit_mask;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::setUpdateLeaf(
+  typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+  const typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& update_mask,
+  const typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& hit_mask)
+{
+  using BufferT = typename UpdateGridT::TreeType::LeafNodeType::Buffer;
+
+  update_leaf.setValueMask(update_mask);
+  update_leaf.buffer() = BufferT(hit_mask);
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TUpdatePolicy>
+void VDBMapping<TData, TConfig, TTreeLayout>::integrateUpdateLeaf(
+  const typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+  typename GridT::TreeType::LeafNodeType& leaf,
+  const TUpdatePolicy& policy,
+  typename UpdateGridT::Accessor& change_acc) const
+{
+  using NodeMaskType = typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType;
+
+  NodeMaskType change_mask;
+  NodeMaskType change_hit_mask;
+  integrateUpdateLeaf(update_leaf, leaf, policy, change_mask, change_hit_mask);
+  if (!change_mask.isOff())
+  {
+    setUpdateLeaf(*change_acc.touchLeaf(update_leaf.origin()), change_mask, change_hit_mask);
+  }
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+template <typename TUpdatePolicy>
+void VDBMapping<TData, TConfig, TTreeLayout>::integrateUpdateLeaf(
+  const typename UpdateGridT::TreeType::LeafNodeType& update_leaf,
+  typename GridT::TreeType::LeafNodeType& leaf,
+  const TUpdatePolicy& policy,
+  typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& change_mask,
+  typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType& change_hit_mask) const
+{
+  using NodeMaskType = typename UpdateGridT::TreeType::LeafNodeType::NodeMaskType;
+
+  const NodeMaskType& update_mask = update_leaf.getValueMask();
+  const NodeMaskType hit_mask     = hitMask(update_leaf);
+  policy.updateLeaf(update_mask, hit_mask, leaf, change_mask);
+  change_hit_mask = hit_mask & change_mask;
+}
+
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::overwriteMap(
+  const typename UpdateGridT::Ptr& update_grid)
 {
+  appendJournalEntry(JournalEntryType::OVERWRITE, update_grid);
+  markMapModified(update_grid->tree());
+  markSnapshotDirty(update_grid->tree());
   typename GridT::Accessor acc = m_vdb_grid->getAccessor();
-  for (UpdateGridT::ValueOnCIter iter = update_grid->cbeginValueOn(); iter; ++iter)
+  for (typename UpdateGridT::ValueOnCIter iter = update_grid->cbeginValueOn(); iter; ++iter)
   {
     if (*iter)
     {
@@ -500,10 +2234,14 @@ void VDBMapping<TData, TConfig>::overwriteMap(const UpdateGridT::Ptr& update_gri
       acc.setActiveState(iter.getCoord(), false);
     }
   }
+  if (m_publish_snapshots)
+  {
+    publishSnapshot();
+  }
 }
 
-template <typename TData, typename TConfig>
-void VDBMapping<TData, TConfig>::setConfig(const TConfig& config)
+template <typename TData, typename TConfig, typename TTreeLayout>
+void VDBMapping<TData, TConfig, TTreeLayout>::setConfig(const TConfig& config)
 {
   if (config.max_range < 0.0)
   {
@@ -511,8 +2249,36 @@ void VDBMapping<TData, TConfig>::setConfig(const TConfig& config)
               << std::endl;
     return;
   }
-  m_max_range          = config.max_range;
-  m_map_directory_path = config.map_directory_path;
-  m_static_env         = config.static_env;
-  m_config_set         = true;
+  if (!config.journaling || config.map_directory_path != m_map_directory_path)
+  {
+    // A running journal is not continued, the next journaled update starts with a checkpoint
+    m_journal.close();
+  }
+  m_max_range                   = config.max_range;
+  m_map_directory_path          = config.map_directory_path;
+  m_static_env                  = config.static_env;
+  m_parallel_raycasting         = config.parallel_raycasting;
+  m_parallel_integration        = config.parallel_integration;
+  m_deduplicate_endpoints       = config.deduplicate_endpoints;
+  m_journaling                  = config.journaling;
+  m_journal_checkpoint_interval = config.journal_checkpoint_interval;
+  m_delayed_loading             = config.delayed_loading;
+  m_max_resident_leaves         = config.max_resident_leaves;
+  m_tile_margin                 = config.tile_margin;
+  m_publish_snapshots           = config.publish_snapshots;
+  m_config_set                  = true;
+  if (m_publish_snapshots && !getGridSnapshot())
+  {
+    publishSnapshot();
+  }
+
+  // Tiles are aligned to leaf nodes, so evicting a tile never splits a leaf
+  const openvdb::Int32 leaf_dim =
+    static_cast<openvdb::Int32>(GridT::TreeType::LeafNodeType::DIM);
+  openvdb::Int32 tile_voxels = 0;
+  if (config.tile_size > 0.0)
+  {
+    tile_voxels = static_cast<openvdb::Int32>(std::ceil(config.tile_size / m_resolution));
+  }
+  m_tile_voxels = (tile_voxels + leaf_dim - 1) / leaf_dim * leaf_dim;
 }
@@ -29,67 +29,175 @@
 
 #include "vdb_mapping/OccupancyVDBMapping.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define VDB_MAPPING_AVX2_KERNEL
+#  include <immintrin.h>
+#endif
+
 namespace vdb_mapping {
 
-bool OccupancyVDBMapping::updateFreeNode(float& voxel_value, bool& active)
+namespace {
+
+using NodeMaskType = OccupancyUpdatePolicy::NodeMaskType;
+using Word         = NodeMaskType::Word;
+
+/*!
+ * \brief Updates the 64 voxels of one mask word voxel by voxel
+ *
+ * \returns New active states of the voxels
+ */
+Word updateWordScalar(const OccupancyUpdatePolicy& policy,
+                      const Word update,
+                      const Word hits,
+                      float* values,
+                      const Word active)
 {
-  voxel_value += m_logodds_miss;
-  if (voxel_value < m_logodds_thres_min)
+  Word result = active;
+  for (openvdb::Index i = 0; i < 64; ++i)
   {
-    active = false;
-    if (voxel_value < m_min_logodds)
+    const Word bit = Word(1) << i;
+    if (!(update & bit))
+    {
+      continue;
+    }
+    bool state = (active & bit) != 0;
+    if (hits & bit)
+    {
+      policy.updateOccupiedNode(values[i], state);
+    }
+    else
     {
-      voxel_value = m_min_logodds;
+      policy.updateFreeNode(values[i], state);
     }
+    result = state ? (result | bit) : (result & ~bit);
   }
-  return true;
+  return result;
 }
 
-bool OccupancyVDBMapping::updateOccupiedNode(float& voxel_value, bool& active)
+#ifdef VDB_MAPPING_AVX2_KERNEL
+/*!
+ * \brief Expands the lowest 8 bits of a mask word to a lane mask
+ */
+__attribute__((target("avx2"))) inline __m256 laneMask(const Word bits)
+{
+  const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256i selected =
+    _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(bits & 0xFF)), lane_bits);
+  return _mm256_castsi256_ps(_mm256_cmpeq_epi32(selected, lane_bits));
+}
+
+/*!
+ * \brief Updates the 64 voxels of one mask word in blocks of 8 lanes
+ *
+ * Yields bitwise identical values and states as updateWordScalar, since every lane performs the
+ * same single precision addition and comparisons as the scalar update rules.
+ *
+ * \returns New active states of the voxels
+ */
+__attribute__((target("avx2"))) Word updateWordAVX2(const OccupancyUpdatePolicy& policy,
+                                                    const Word update,
+                                                    const Word hits,
+                                                    float* values,
+                                                    const Word active)
 {
-  voxel_value += m_logodds_hit;
-  if (voxel_value > m_logodds_thres_max)
+  const __m256 logodds_hit       = _mm256_set1_ps(policy.logodds_hit);
+  const __m256 logodds_miss      = _mm256_set1_ps(policy.logodds_miss);
+  const __m256 logodds_thres_min = _mm256_set1_ps(policy.logodds_thres_min);
+  const __m256 logodds_thres_max = _mm256_set1_ps(policy.logodds_thres_max);
+  const __m256 max_logodds       = _mm256_set1_ps(policy.max_logodds);
+  const __m256 min_logodds       = _mm256_set1_ps(policy.min_logodds);
+
+  Word switched_on  = 0;
+  Word switched_off = 0;
+  for (openvdb::Index block = 0; block < 8; ++block)
   {
-    active = true;
-    if (voxel_value > m_max_logodds)
+    const openvdb::Index shift = 8 * block;
+    if (((update >> shift) & 0xFF) == 0)
     {
-      voxel_value = m_max_logodds;
+      continue;
     }
+    const __m256 update_lanes = laneMask(update >> shift);
+    const __m256 hit_lanes    = laneMask(hits >> shift);
+    const __m256 miss_lanes   = _mm256_andnot_ps(hit_lanes, update_lanes);
+
+    float* block_values = values + shift;
+    const __m256 old    = _mm256_loadu_ps(block_values);
+    const __m256 sum = _mm256_add_ps(old, _mm256_blendv_ps(logodds_miss, logodds_hit, hit_lanes));
+
+    const __m256 above =
+      _mm256_and_ps(hit_lanes, _mm256_cmp_ps(sum, logodds_thres_max, _CMP_GT_OQ));
+    const __m256 below =
+      _mm256_and_ps(miss_lanes, _mm256_cmp_ps(sum, logodds_thres_min, _CMP_LT_OQ));
+    const __m256 clamp_max = _mm256_and_ps(above, _mm256_cmp_ps(sum, max_logodds, _CMP_GT_OQ));
+    const __m256 clamp_min = _mm256_and_ps(below, _mm256_cmp_ps(sum, min_logodds, _CMP_LT_OQ));
+
+    __m256 result = _mm256_blendv_ps(old, sum, update_lanes);
+    result        = _mm256_blendv_ps(result, max_logodds, clamp_max);
+    result        = _mm256_blendv_ps(result, min_logodds, clamp_min);
+    _mm256_storeu_ps(block_values, result);
+
+    switched_on |= static_cast<Word>(_mm256_movemask_ps(above) & 0xFF) << shift;
+    switched_off |= static_cast<Word>(_mm256_movemask_ps(below) & 0xFF) << shift;
   }
-  return true;
+  return (active | switched_on) & ~switched_off;
 }
+#endif
 
+} // namespace
 
-void OccupancyVDBMapping::setConfig(const Config& config)
+bool OccupancyUpdatePolicy::leafKernelSupported(const LeafKernel kernel)
 {
-  // call base class function
-  VDBMapping::setConfig(config);
-
-  // Sanity Check for input config
-  if (config.prob_miss > 0.5)
+  if (kernel != LeafKernel::AVX2)
   {
-    std::cerr << "Probability for a miss should be below 0.5 but is " << config.prob_miss
-              << std::endl;
-    return;
+    return true;
   }
-  if (config.prob_hit < 0.5)
+#ifdef VDB_MAPPING_AVX2_KERNEL
+  static const bool avx2_supported = __builtin_cpu_supports("avx2");
+  return avx2_supported;
+#else
+  return false;
+#endif
+}
+
+void OccupancyUpdatePolicy::updateLeaf(const NodeMaskType& update_mask,
+                                       const NodeMaskType& hit_mask,
+                                       LeafT& leaf,
+                                       NodeMaskType& change_mask) const
+{
+#ifdef VDB_MAPPING_AVX2_KERNEL
+  const bool use_avx2 = leaf_kernel != LeafKernel::SCALAR && leafKernelSupported(LeafKernel::AVX2);
+#endif
+
+  float* values            = leaf.buffer().data();
+  NodeMaskType active_mask = leaf.getValueMask();
+  for (openvdb::Index n = 0; n < NodeMaskType::WORD_COUNT; ++n)
   {
-    std::cerr << "Probability for a hit should be above 0.5 but is " << config.prob_hit
-              << std::endl;
-    return;
+    const Word update = update_mask.getWord<Word>(n);
+    if (update == 0)
+    {
+      continue;
+    }
+    const Word hits        = hit_mask.getWord<Word>(n) & update;
+    Word& active           = active_mask.getWord<Word>(n);
+    const Word last_active = active;
+    float* word_values     = values + 64 * n;
+#ifdef VDB_MAPPING_AVX2_KERNEL
+    if (use_avx2)
+    {
+      active = updateWordAVX2(*this, update, hits, word_values, last_active);
+    }
+    else
+#endif
+    {
+      active = updateWordScalar(*this, update, hits, word_values, last_active);
+    }
+    change_mask.getWord<Word>(n) = last_active ^ active;
   }
-
-  // Store probabilities as log odds
-  m_logodds_miss = static_cast<float>(log(config.prob_miss) - log(1 - config.prob_miss));
-  m_logodds_hit  = static_cast<float>(log(config.prob_hit) - log(1 - config.prob_hit));
-  m_logodds_thres_min =
-    static_cast<float>(log(config.prob_thres_min) - log(1 - config.prob_thres_min));
-  m_logodds_thres_max =
-    static_cast<float>(log(config.prob_thres_max) - log(1 - config.prob_thres_max));
-  // Values to clamp the logodds in order to prevent non dynamic map behavior
-  m_max_logodds = static_cast<float>(log(0.99) - log(0.01));
-  m_min_logodds = static_cast<float>(log(0.01) - log(0.99));
-  m_config_set  = true;
+  leaf.setValueMask(active_mask);
 }
 
+template class OccupancyVDBMappingT<DefaultTreeLayout>;
+template class OccupancyVDBMappingT<LongRangeTreeLayout>;
+template class OccupancyVDBMappingT<IndoorTreeLayout>;
+
 } // namespace vdb_mapping
@@ -1,5 +1,18 @@
 #include "gtest/gtest.h"
+#include <vdb_mapping/IngestionPipeline.h>
 #include <vdb_mapping/OccupancyVDBMapping.h>
+#include <vdb_mapping/QuantizedOccupancyVDBMapping.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <unistd.h>
 
 namespace vdb_mapping {
 
@@ -143,6 +156,1661 @@ TEST(Mapping, ResetMap)
   EXPECT_EQ(acc.getValue(openvdb::Coord(0, 0, 1)), 0.0);
 }
 
+TEST(Mapping, ParallelRaycasting)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+
+  OccupancyVDBMapping serial_map(resolution);
+  serial_map.setConfig(conf);
+  conf.parallel_raycasting = true;
+  OccupancyVDBMapping parallel_map(resolution);
+  parallel_map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 5000; ++i)
+  {
+    double angle = 0.0013 * i;
+    double range = 1.0 + (i % 50) * 0.1;
+    cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.001 * (i % 97));
+  }
+  Eigen::Matrix<double, 3, 1> origin(0.05, -0.02, 0.1);
+
+  OccupancyVDBMapping::UpdateGridT::Ptr serial_update;
+  OccupancyVDBMapping::UpdateGridT::Ptr serial_overwrite;
+  OccupancyVDBMapping::UpdateGridT::Ptr parallel_update;
+  OccupancyVDBMapping::UpdateGridT::Ptr parallel_overwrite;
+  serial_map.insertPointCloud(cloud, origin, serial_update, serial_overwrite);
+  parallel_map.insertPointCloud(cloud, origin, parallel_update, parallel_overwrite);
+
+  EXPECT_EQ(serial_update->activeVoxelCount(), parallel_update->activeVoxelCount());
+  OccupancyVDBMapping::UpdateGridT::Accessor acc = parallel_update->getAccessor();
+  for (auto iter = serial_update->cbeginValueOn(); iter; ++iter)
+  {
+    EXPECT_TRUE(acc.isValueOn(iter.getCoord()));
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+  }
+}
+
+TEST(Mapping, ParallelIntegration)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+
+  OccupancyVDBMapping serial_map(resolution);
+  serial_map.setConfig(conf);
+  conf.parallel_integration = true;
+  OccupancyVDBMapping parallel_map(resolution);
+  parallel_map.setConfig(conf);
+
+  for (int scan = 0; scan < 3; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 2000; ++i)
+    {
+      double angle = 0.003 * i + 0.1 * scan;
+      double range = 1.0 + ((i + scan) % 30) * 0.1;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.01 * scan);
+    }
+    Eigen::Matrix<double, 3, 1> origin(0.1 * scan, 0, 0);
+
+    OccupancyVDBMapping::UpdateGridT::Ptr serial_update;
+    OccupancyVDBMapping::UpdateGridT::Ptr serial_overwrite;
+    OccupancyVDBMapping::UpdateGridT::Ptr parallel_update;
+    OccupancyVDBMapping::UpdateGridT::Ptr parallel_overwrite;
+    serial_map.insertPointCloud(cloud, origin, serial_update, serial_overwrite);
+    parallel_map.insertPointCloud(cloud, origin, parallel_update, parallel_overwrite);
+
+    EXPECT_EQ(serial_overwrite->activeVoxelCount(), parallel_overwrite->activeVoxelCount());
+    OccupancyVDBMapping::UpdateGridT::Accessor overwrite_acc = parallel_overwrite->getAccessor();
+    for (auto iter = serial_overwrite->cbeginValueOn(); iter; ++iter)
+    {
+      EXPECT_TRUE(overwrite_acc.isValueOn(iter.getCoord()));
+      EXPECT_EQ(overwrite_acc.getValue(iter.getCoord()), *iter);
+    }
+  }
+
+  OccupancyVDBMapping::GridT::Accessor acc = parallel_map.getGrid()->getAccessor();
+  for (auto iter = serial_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+  EXPECT_EQ(serial_map.getGrid()->activeVoxelCount(), parallel_map.getGrid()->activeVoxelCount());
+  EXPECT_EQ(serial_map.getGrid()->tree().leafCount(), parallel_map.getGrid()->tree().leafCount());
+}
+
+TEST(Mapping, MapSection)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 3000; ++i)
+  {
+    double angle = 0.0021 * i;
+    double range = 1.0 + (i % 25) * 0.1;
+    cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.01 * (i % 40));
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+  map.insertPointCloud(cloud, origin);
+
+  Eigen::Matrix<double, 3, 1> min_boundary(-0.73, 0.21, -0.05);
+  Eigen::Matrix<double, 3, 1> max_boundary(2.47, 3.18, 0.33);
+  Eigen::Matrix<double, 4, 4> tf = Eigen::Matrix<double, 4, 4>::Identity();
+  openvdb::CoordBBox bbox(openvdb::Coord::floor(map.getGrid()->worldToIndex(
+                            openvdb::Vec3d(min_boundary.x(), min_boundary.y(), min_boundary.z()))),
+                          openvdb::Coord::floor(map.getGrid()->worldToIndex(
+                            openvdb::Vec3d(max_boundary.x(), max_boundary.y(), max_boundary.z()))));
+
+  OccupancyVDBMapping::UpdateGridT::Ptr update_section =
+    map.getMapSectionUpdateGrid(min_boundary, max_boundary, tf);
+  OccupancyVDBMapping::GridT::Ptr section = map.getMapSectionGrid(min_boundary, max_boundary, tf);
+  OccupancyVDBMapping::GridT::Ptr value_section =
+    map.getMapSectionGrid(min_boundary, max_boundary, tf, true);
+
+  OccupancyVDBMapping::UpdateGridT::Accessor update_acc = update_section->getAccessor();
+  OccupancyVDBMapping::GridT::Accessor section_acc      = section->getAccessor();
+  OccupancyVDBMapping::GridT::Accessor value_acc        = value_section->getAccessor();
+  openvdb::Index64 expected_count                       = 0;
+  for (auto iter = map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    const openvdb::Coord& coord = iter.getCoord();
+    if (!bbox.isInside(coord))
+    {
+      EXPECT_FALSE(update_acc.isValueOn(coord));
+      EXPECT_FALSE(value_acc.isValueOn(coord));
+      EXPECT_EQ(value_acc.getValue(coord), 0.0);
+      continue;
+    }
+    expected_count += iter.isValueOn() ? 1 : 0;
+    EXPECT_EQ(update_acc.isValueOn(coord), iter.isValueOn());
+    EXPECT_EQ(section_acc.isValueOn(coord), iter.isValueOn());
+    EXPECT_EQ(value_acc.isValueOn(coord), iter.isValueOn());
+    EXPECT_EQ(value_acc.getValue(coord), *iter);
+  }
+  EXPECT_GT(expected_count, 0u);
+  EXPECT_EQ(update_section->activeVoxelCount(), expected_count);
+  EXPECT_EQ(section->activeVoxelCount(), expected_count);
+  EXPECT_EQ(value_section->activeVoxelCount(), expected_count);
+  EXPECT_FALSE(section->metaValue<bool>("values"));
+  EXPECT_TRUE(value_section->metaValue<bool>("values"));
+}
+
+TEST(Mapping, ApplyMapSection)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+  OccupancyVDBMapping source_map(resolution);
+  source_map.setConfig(conf);
+  OccupancyVDBMapping active_map(resolution);
+  active_map.setConfig(conf);
+  OccupancyVDBMapping value_map(resolution);
+  value_map.setConfig(conf);
+
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+  OccupancyVDBMapping::PointCloudT::Ptr source_cloud(new OccupancyVDBMapping::PointCloudT);
+  OccupancyVDBMapping::PointCloudT::Ptr target_cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 3000; ++i)
+  {
+    double angle = 0.0021 * i;
+    source_cloud->points.emplace_back(
+      1.5 * std::cos(angle), 1.5 * std::sin(angle), 0.01 * (i % 40));
+    target_cloud->points.emplace_back(
+      2.5 * std::cos(angle), 2.5 * std::sin(angle), 0.01 * (i % 40));
+  }
+  source_map.insertPointCloud(source_cloud, origin);
+  active_map.insertPointCloud(target_cloud, origin);
+  value_map.insertPointCloud(target_cloud, origin);
+
+  Eigen::Matrix<double, 3, 1> min_boundary(-0.73, 0.21, -0.05);
+  Eigen::Matrix<double, 3, 1> max_boundary(2.87, 3.18, 0.33);
+  Eigen::Matrix<double, 4, 4> tf = Eigen::Matrix<double, 4, 4>::Identity();
+  OccupancyVDBMapping::UpdateGridT::Ptr update_section =
+    source_map.getMapSectionUpdateGrid(min_boundary, max_boundary, tf);
+  OccupancyVDBMapping::GridT::Ptr value_section =
+    source_map.getMapSectionGrid(min_boundary, max_boundary, tf, true);
+  openvdb::Vec3d bb_min = value_section->metaValue<openvdb::Vec3d>("bb_min");
+  openvdb::Vec3d bb_max = value_section->metaValue<openvdb::Vec3d>("bb_max");
+  openvdb::CoordBBox bbox(openvdb::Coord::floor(bb_min), openvdb::Coord::floor(bb_max));
+
+  OccupancyVDBMapping::GridT::Ptr reference = active_map.getGrid()->deepCopy();
+  active_map.applyMapSectionUpdateGrid(update_section);
+  value_map.applyMapSectionGrid(value_section);
+
+  OccupancyVDBMapping::GridT::Accessor source_acc    = source_map.getGrid()->getAccessor();
+  OccupancyVDBMapping::GridT::Accessor reference_acc = reference->getAccessor();
+  OccupancyVDBMapping::GridT::Accessor active_acc    = active_map.getGrid()->getAccessor();
+  OccupancyVDBMapping::GridT::Accessor value_acc     = value_map.getGrid()->getAccessor();
+  for (auto iter = reference->cbeginValueAll(); iter; ++iter)
+  {
+    const openvdb::Coord& coord = iter.getCoord();
+    if (bbox.isInside(coord))
+    {
+      continue;
+    }
+    EXPECT_EQ(active_acc.isValueOn(coord), iter.isValueOn());
+    EXPECT_EQ(value_acc.isValueOn(coord), iter.isValueOn());
+    EXPECT_EQ(value_acc.getValue(coord), *iter);
+  }
+  // Map voxels the section holds no leaf or tile for are reset to the background as well
+  std::size_t reset_voxels = 0;
+  for (auto iter = bbox.begin(); iter; ++iter)
+  {
+    EXPECT_EQ(active_acc.isValueOn(*iter), source_acc.isValueOn(*iter));
+    EXPECT_EQ(value_acc.isValueOn(*iter), source_acc.isValueOn(*iter));
+    EXPECT_EQ(value_acc.getValue(*iter), source_acc.getValue(*iter));
+    if (!value_section->tree().probeConstLeaf(*iter) && reference_acc.getValue(*iter) != 0.0)
+    {
+      ++reset_voxels;
+    }
+  }
+  EXPECT_GT(reset_voxels, 0u);
+
+  // Partially covered section leaves overwrite the map values inside the bounding box just like
+  // whole leaves, even where the section holds the background value
+  std::size_t partial_leaves = 0;
+  std::size_t cleared_voxels = 0;
+  for (auto leaf_iter = value_section->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+  {
+    if (bbox.isInside(leaf_iter->getNodeBoundingBox()))
+    {
+      continue;
+    }
+    ++partial_leaves;
+    for (auto iter = leaf_iter->cbeginValueAll(); iter; ++iter)
+    {
+      const openvdb::Coord coord = iter.getCoord();
+      if (!bbox.isInside(coord))
+      {
+        continue;
+      }
+      EXPECT_EQ(value_acc.getValue(coord), *iter);
+      EXPECT_EQ(value_acc.isValueOn(coord), iter.isValueOn());
+      if (*iter == 0.0 && reference_acc.getValue(coord) != 0.0)
+      {
+        ++cleared_voxels;
+      }
+    }
+  }
+  EXPECT_GT(partial_leaves, 0u);
+  EXPECT_GT(cleared_voxels, 0u);
+}
+
+TEST(Mapping, Raytrace)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 6;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 2000; ++i)
+  {
+    double angle = 0.00314 * i;
+    cloud->points.emplace_back(4.0 * std::cos(angle), 4.0 * std::sin(angle), 0.05);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+  map.insertPointCloud(cloud, origin);
+  // Active tile in empty space behind the scan
+  map.getGrid()->tree().fill(
+    openvdb::CoordBBox(openvdb::Coord(-256, -128, -64), openvdb::Coord(-129, -1, 63)), 1.0, true);
+
+  OccupancyVDBMapping::GridT::ConstAccessor acc = map.getGrid()->getConstAccessor();
+  openvdb::Vec3d ray_origin(0.01, 0.02, 0.03);
+  for (int i = 0; i < 500; ++i)
+  {
+    double angle = 0.0126 * i;
+    openvdb::Vec3d direction(std::cos(angle), std::sin(angle), 0.01 * (i % 5));
+    openvdb::Vec3d end_point;
+    bool hit = map.raytrace(ray_origin, direction, 20.0, end_point);
+
+    // Reference voxel by voxel traversal
+    OccupancyVDBMapping::RayT ray(
+      map.getGrid()->worldToIndex(ray_origin), direction.unit(), 0.0, 20.0 / resolution);
+    OccupancyVDBMapping::DDAT dda(ray);
+    bool expected_hit = false;
+    do
+    {
+      if (acc.isValueOn(dda.voxel()))
+      {
+        expected_hit = true;
+        break;
+      }
+    } while (dda.step());
+
+    ASSERT_EQ(hit, expected_hit);
+    if (hit)
+    {
+      EXPECT_EQ(openvdb::Coord::round(map.getGrid()->worldToIndex(end_point)), dda.voxel());
+    }
+  }
+}
+
+TEST(Mapping, RaytraceBatch)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 6;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 1000; ++i)
+  {
+    double angle = 0.00314 * i;
+    cloud->points.emplace_back(3.0 * std::cos(angle), 3.0 * std::sin(angle), 0.05);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+  map.insertPointCloud(cloud, origin);
+
+  const std::size_t num_rays = 2000;
+  std::vector<openvdb::Vec3d> origins;
+  std::vector<openvdb::Vec3d> directions;
+  for (std::size_t i = 0; i < num_rays; ++i)
+  {
+    double angle = 0.00314 * i;
+    origins.emplace_back(0.01 * (i % 7), 0.02, 0.03);
+    directions.emplace_back(std::cos(angle), std::sin(angle), 0.0);
+  }
+  std::vector<openvdb::Vec3d> end_points(num_rays);
+  std::vector<double> distances(num_rays);
+  std::unique_ptr<bool[]> hits(new bool[num_rays]);
+  map.raytraceBatch(origins.data(),
+                    directions.data(),
+                    num_rays,
+                    10.0,
+                    end_points.data(),
+                    distances.data(),
+                    hits.get());
+
+  std::size_t hit_count = 0;
+  for (std::size_t i = 0; i < num_rays; ++i)
+  {
+    openvdb::Vec3d end_point;
+    ASSERT_EQ(hits[i], map.raytrace(origins[i], directions[i], 10.0, end_point));
+    if (hits[i])
+    {
+      ++hit_count;
+      EXPECT_EQ(end_points[i], end_point);
+      EXPECT_GE(distances[i], 0.0);
+      EXPECT_LE(distances[i], 10.0);
+      EXPECT_NEAR(distances[i], (end_point - origins[i]).length(), 2 * resolution);
+    }
+  }
+  EXPECT_GT(hit_count, 0u);
+}
+
+TEST(Mapping, DeduplicateEndpoints)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 3;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+
+  // Dense depth image like cloud with many points per end voxel, partially beyond max range
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int u = 0; u < 160; ++u)
+  {
+    for (int v = 0; v < 120; ++v)
+    {
+      double depth = u < 80 ? 2.0 : 4.0;
+      cloud->points.emplace_back(depth, (u - 80) * 0.002 * depth, (v - 60) * 0.002 * depth);
+    }
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+
+  for (const bool static_env : {false, true})
+  {
+    conf.static_env            = static_env;
+    conf.deduplicate_endpoints = false;
+    OccupancyVDBMapping map(resolution);
+    map.setConfig(conf);
+    conf.deduplicate_endpoints = true;
+    OccupancyVDBMapping dedup_map(resolution);
+    dedup_map.setConfig(conf);
+
+    OccupancyVDBMapping::UpdateGridT::Ptr update;
+    OccupancyVDBMapping::UpdateGridT::Ptr overwrite;
+    OccupancyVDBMapping::UpdateGridT::Ptr dedup_update;
+    OccupancyVDBMapping::UpdateGridT::Ptr dedup_overwrite;
+    map.insertPointCloud(cloud, origin, update, overwrite);
+    dedup_map.insertPointCloud(cloud, origin, dedup_update, dedup_overwrite);
+
+    // Every deduplicated ray is one of the original rays
+    ASSERT_GT(dedup_update->activeVoxelCount(), 0u);
+    EXPECT_LE(dedup_update->activeVoxelCount(), update->activeVoxelCount());
+    OccupancyVDBMapping::UpdateGridT::Accessor acc = update->getAccessor();
+    for (auto iter = dedup_update->cbeginValueOn(); iter; ++iter)
+    {
+      EXPECT_TRUE(acc.isValueOn(iter.getCoord()));
+    }
+
+    // Each end voxel keeps one ray, so both updates mark exactly the same voxels as hits
+    std::size_t hit_count                                = 0;
+    OccupancyVDBMapping::UpdateGridT::Accessor dedup_acc = dedup_update->getAccessor();
+    for (auto iter = update->cbeginValueOn(); iter; ++iter)
+    {
+      EXPECT_EQ(dedup_acc.isValueOn(iter.getCoord()) && dedup_acc.getValue(iter.getCoord()), *iter)
+        << "static_env " << static_env << " voxel " << iter.getCoord();
+      hit_count += *iter ? 1 : 0;
+    }
+    EXPECT_GT(hit_count, 0u);
+  }
+}
+
+TEST(Mapping, SaveMapAsync)
+{
+  char directory_template[] = "/tmp/vdb_mapping_testXXXXXX";
+  ASSERT_NE(mkdtemp(directory_template), nullptr);
+
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range          = 4;
+  conf.prob_hit           = 0.9;
+  conf.prob_miss          = 0.1;
+  conf.prob_thres_max     = 0.51;
+  conf.prob_thres_min     = 0.49;
+  conf.map_directory_path = std::string(directory_template) + "/";
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 2000; ++i)
+  {
+    double angle = 0.00314 * i;
+    cloud->points.emplace_back(2.0 * std::cos(angle), 2.0 * std::sin(angle), 0.0);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+  map.insertPointCloud(cloud, origin);
+  OccupancyVDBMapping::GridT::Ptr expected = map.getGrid()->deepCopy();
+
+  std::future<bool> saved = map.saveMapAsync();
+  // Mapping continues while the snapshot is written
+  map.insertPointCloud(cloud, Eigen::Matrix<double, 3, 1>(0.5, 0.5, 0));
+  ASSERT_TRUE(saved.get());
+
+  std::string file_name;
+  std::unique_ptr<DIR, int (*)(DIR*)> directory(opendir(directory_template), closedir);
+  ASSERT_TRUE(directory);
+  while (dirent* entry = readdir(directory.get()))
+  {
+    std::string name(entry->d_name);
+    EXPECT_EQ(name.find(".tmp"), std::string::npos);
+    if (name.size() > 4 && name.substr(name.size() - 4) == ".vdb")
+    {
+      file_name = conf.map_directory_path + name;
+    }
+  }
+  ASSERT_FALSE(file_name.empty());
+
+  OccupancyVDBMapping loaded_map(resolution);
+  loaded_map.setConfig(conf);
+  ASSERT_TRUE(loaded_map.loadMap(file_name));
+  EXPECT_EQ(loaded_map.getGrid()->activeVoxelCount(), expected->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = loaded_map.getGrid()->getAccessor();
+  for (auto iter = expected->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+  std::remove(file_name.c_str());
+  rmdir(directory_template);
+}
+
+TEST(Mapping, Journal)
+{
+  char directory_template[] = "/tmp/vdb_mapping_testXXXXXX";
+  ASSERT_NE(mkdtemp(directory_template), nullptr);
+
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range                   = 4;
+  conf.prob_hit                    = 0.9;
+  conf.prob_miss                   = 0.1;
+  conf.prob_thres_max              = 0.51;
+  conf.prob_thres_min              = 0.49;
+  conf.map_directory_path          = std::string(directory_template) + "/";
+  conf.journaling                  = true;
+  conf.journal_checkpoint_interval = 3;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  for (int scan = 0; scan < 5; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 1000; ++i)
+    {
+      double angle = 0.00628 * i;
+      double range = 1.0 + 0.3 * scan;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    map.insertPointCloud(cloud, Eigen::Matrix<double, 3, 1>(0.1 * scan, 0, 0));
+  }
+  OccupancyVDBMapping::UpdateGridT::Ptr overwrite = OccupancyVDBMapping::UpdateGridT::create(false);
+  overwrite->getAccessor().setValueOn(openvdb::Coord(50, 50, 50), true);
+  map.overwriteMap(overwrite);
+
+  // Sections of another map are journaled as they are applied
+  OccupancyVDBMapping other_map(resolution);
+  other_map.setConfig(conf);
+  OccupancyVDBMapping::PointCloudT::Ptr other_cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 1000; ++i)
+  {
+    double angle = 0.00628 * i;
+    other_cloud->points.emplace_back(
+      2.0 + 0.8 * std::cos(angle), 0.8 * std::sin(angle), 0.05 * (i % 4));
+  }
+  other_map.insertPointCloud(other_cloud, Eigen::Matrix<double, 3, 1>(2.0, 0, 0));
+  Eigen::Matrix<double, 4, 4> tf = Eigen::Matrix<double, 4, 4>::Identity();
+  Eigen::Matrix<double, 3, 1> value_min(1.43, -0.57, -0.1);
+  Eigen::Matrix<double, 3, 1> value_max(2.61, 0.39, 0.2);
+  Eigen::Matrix<double, 3, 1> active_min(-0.3, 0.5, -0.1);
+  Eigen::Matrix<double, 3, 1> active_max(0.7, 1.5, 0.2);
+  map.applyMapSectionGrid(other_map.getMapSectionGrid(value_min, value_max, tf, true));
+  map.applyMapSectionUpdateGrid(other_map.getMapSectionUpdateGrid(active_min, active_max, tf));
+
+  OccupancyVDBMapping loaded_map(resolution);
+  conf.journaling = false;
+  loaded_map.setConfig(conf);
+  ASSERT_TRUE(loaded_map.loadJournaledMap());
+
+  EXPECT_EQ(loaded_map.getGrid()->activeVoxelCount(), map.getGrid()->activeVoxelCount());
+  EXPECT_TRUE(loaded_map.getGrid()->getConstAccessor().isValueOn(openvdb::Coord(50, 50, 50)));
+  OccupancyVDBMapping::GridT::Accessor acc = loaded_map.getGrid()->getAccessor();
+  for (auto iter = map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+
+  std::unique_ptr<DIR, int (*)(DIR*)> directory(opendir(directory_template), closedir);
+  ASSERT_TRUE(directory);
+  while (dirent* entry = readdir(directory.get()))
+  {
+    std::string name(entry->d_name);
+    if (name != "." && name != "..")
+    {
+      std::remove((conf.map_directory_path + name).c_str());
+    }
+  }
+  rmdir(directory_template);
+}
+
+TEST(Mapping, DelayedLoading)
+{
+  char directory_template[] = "/tmp/vdb_mapping_testXXXXXX";
+  ASSERT_NE(mkdtemp(directory_template), nullptr);
+  const std::string file_path = std::string(directory_template) + "/map.vdb";
+
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 2000; ++i)
+  {
+    double angle = 0.00314 * i;
+    cloud->points.emplace_back(3.0 * std::cos(angle), 3.0 * std::sin(angle), 0.0);
+  }
+  map.insertPointCloud(cloud, Eigen::Matrix<double, 3, 1>(0, 0, 0));
+  openvdb::io::File file_handle(file_path);
+  openvdb::GridPtrVec grids;
+  grids.push_back(map.getGrid());
+  file_handle.write(grids);
+  file_handle.close();
+
+  conf.delayed_loading     = true;
+  conf.max_resident_leaves = 4;
+  OccupancyVDBMapping loaded_map(resolution);
+  loaded_map.setConfig(conf);
+  ASSERT_TRUE(loaded_map.loadMap(file_path));
+  const std::size_t leaf_count = loaded_map.getGrid()->tree().leafCount();
+  ASSERT_GT(leaf_count, 4u);
+  EXPECT_LT(loaded_map.residentLeafCount(), leaf_count);
+
+  // Queries page in the touched leaves, which are paged out again leaf by leaf
+  auto query_all_leaves = [&]() {
+    for (auto leaf_iter = map.getGrid()->tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+    {
+      OccupancyVDBMapping::GridT::Accessor acc = loaded_map.getGrid()->getAccessor();
+      for (auto iter = leaf_iter->cbeginValueAll(); iter; ++iter)
+      {
+        EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+        EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+      }
+      EXPECT_TRUE(loaded_map.enforceResidentLeafLimit());
+      EXPECT_LE(loaded_map.residentLeafCount(), 4u);
+    }
+  };
+  query_all_leaves();
+  EXPECT_EQ(loaded_map.getGrid()->tree().leafCount(), leaf_count);
+  EXPECT_EQ(loaded_map.getGrid()->activeVoxelCount(), map.getGrid()->activeVoxelCount());
+
+  // Modified leaves stay resident, while all others can still be paged out
+  OccupancyVDBMapping::PointCloudT::Ptr local_cloud(new OccupancyVDBMapping::PointCloudT);
+  local_cloud->points.emplace_back(3.0, 0.05, 0.0);
+  map.insertPointCloud(local_cloud, Eigen::Matrix<double, 3, 1>(2.5, 0, 0));
+  loaded_map.insertPointCloud(local_cloud, Eigen::Matrix<double, 3, 1>(2.5, 0, 0));
+  query_all_leaves();
+  EXPECT_EQ(loaded_map.getGrid()->activeVoxelCount(), map.getGrid()->activeVoxelCount());
+
+  std::remove(file_path.c_str());
+  rmdir(directory_template);
+}
+
+TEST(Mapping, TiledMap)
+{
+  char directory_template[] = "/tmp/vdb_mapping_testXXXXXX";
+  ASSERT_NE(mkdtemp(directory_template), nullptr);
+
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range          = 2;
+  conf.prob_hit           = 0.9;
+  conf.prob_miss          = 0.1;
+  conf.prob_thres_max     = 0.51;
+  conf.prob_thres_min     = 0.49;
+  conf.static_env         = false;
+  conf.map_directory_path = std::string(directory_template) + "/";
+  OccupancyVDBMapping reference_map(resolution);
+  reference_map.setConfig(conf);
+  conf.tile_size   = 1.6;
+  conf.tile_margin = 1;
+  OccupancyVDBMapping tiled_map(resolution);
+  tiled_map.setConfig(conf);
+
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 2000; ++i)
+  {
+    double angle = 0.00314 * i;
+    cloud->points.emplace_back(1.5 * std::cos(angle), 1.5 * std::sin(angle), 0.1 * (i % 3));
+  }
+  std::vector<double> trajectory = {0.0, 0.5, 12.0, 20.0, 0.3};
+  for (double x : trajectory)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr scan(new OccupancyVDBMapping::PointCloudT);
+    for (const auto& pt : cloud->points)
+    {
+      scan->points.emplace_back(pt.x + x, pt.y, pt.z);
+    }
+    Eigen::Matrix<double, 3, 1> origin(x, 0, 0);
+    reference_map.insertPointCloud(scan, origin);
+    tiled_map.insertPointCloud(scan, origin);
+
+    // Only the tiles around the sensor are kept in memory
+    openvdb::CoordBBox active_bbox = tiled_map.getGrid()->evalActiveVoxelBoundingBox();
+    EXPECT_LT(active_bbox.max().x() - active_bbox.min().x(), 80);
+  }
+
+  // Within the resident window the tiled map matches the map held completely in memory
+  OccupancyVDBMapping::GridT::Accessor acc = tiled_map.getGrid()->getAccessor();
+  openvdb::CoordBBox window(openvdb::Coord(-17, -20, -20), openvdb::Coord(23, 20, 20));
+  std::size_t compared = 0;
+  for (auto iter = reference_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    if (window.isInside(iter.getCoord()))
+    {
+      EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+      EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+      ++compared;
+    }
+  }
+  EXPECT_GT(compared, 0u);
+  EXPECT_LT(tiled_map.getGrid()->activeVoxelCount(), reference_map.getGrid()->activeVoxelCount());
+  EXPECT_TRUE(tiled_map.storeResidentTiles());
+
+  // Removes all files of the map directory and counts the tile files among them
+  auto clear_directory = [&]() {
+    std::size_t tile_files = 0;
+    std::unique_ptr<DIR, int (*)(DIR*)> directory(opendir(directory_template), closedir);
+    EXPECT_TRUE(directory);
+    if (!directory)
+    {
+      return tile_files;
+    }
+    while (dirent* entry = readdir(directory.get()))
+    {
+      std::string name(entry->d_name);
+      if (name != "." && name != "..")
+      {
+        tile_files += name.compare(0, 5, "tile_") == 0 ? 1 : 0;
+        std::remove((conf.map_directory_path + name).c_str());
+      }
+    }
+    return tile_files;
+  };
+  EXPECT_GT(clear_directory(), 0u);
+
+  // Pruned free space is written as inactive tiles when its map tile is evicted and has to come
+  // back unchanged when the map tile is loaded again
+  OccupancyVDBMapping pruned_map(resolution);
+  pruned_map.setConfig(conf);
+  auto insert_at = [&](const double x) {
+    OccupancyVDBMapping::PointCloudT::Ptr scan(new OccupancyVDBMapping::PointCloudT);
+    for (const auto& pt : cloud->points)
+    {
+      scan->points.emplace_back(pt.x + x, pt.y, pt.z);
+    }
+    pruned_map.insertPointCloud(scan, Eigen::Matrix<double, 3, 1>(x, 0, 0));
+  };
+  insert_at(0.0);
+  const float min_logodds = static_cast<float>(std::log(0.01) - std::log(0.99));
+  const openvdb::CoordBBox free_bbox(openvdb::Coord(0, 0, -16), openvdb::Coord(15, 15, -9));
+  pruned_map.getGrid()->tree().denseFill(free_bbox, min_logodds, false);
+  PruneStatistics statistics;
+  while (!statistics.complete)
+  {
+    statistics = pruned_map.pruneMap(std::chrono::microseconds(1000));
+  }
+  EXPECT_FALSE(pruned_map.getGrid()->tree().probeConstLeaf(free_bbox.min()));
+
+  insert_at(20.0);
+  EXPECT_EQ(pruned_map.getGrid()->tree().getValue(free_bbox.min()), 0.0f);
+  insert_at(0.0);
+  OccupancyVDBMapping::GridT::Accessor pruned_acc = pruned_map.getGrid()->getAccessor();
+  for (auto coord = free_bbox.begin(); coord; ++coord)
+  {
+    EXPECT_EQ(pruned_acc.getValue(*coord), min_logodds);
+    EXPECT_FALSE(pruned_acc.isValueOn(*coord));
+  }
+  EXPECT_TRUE(pruned_map.storeResidentTiles());
+  EXPECT_GT(clear_directory(), 0u);
+  rmdir(directory_template);
+}
+
+TEST(Mapping, ConcurrentSnapshotReaders)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range         = 4;
+  conf.prob_hit          = 0.9;
+  conf.prob_miss         = 0.1;
+  conf.prob_thres_max    = 0.51;
+  conf.prob_thres_min    = 0.49;
+  conf.static_env        = false;
+  conf.publish_snapshots = true;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+  ASSERT_TRUE(map.getGridSnapshot());
+
+  std::atomic<bool> mapping_done(false);
+  std::atomic<std::size_t> snapshots_read(0);
+  std::vector<long> max_access_us(4, 0);
+  auto reader = [&](const std::size_t reader_index) {
+    while (!mapping_done)
+    {
+      auto start = std::chrono::steady_clock::now();
+      OccupancyVDBMapping::GridT::ConstPtr snapshot = map.getGridSnapshot();
+      long access_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+      max_access_us[reader_index] = std::max(max_access_us[reader_index], access_us);
+      // The snapshot is immutable, so repeated traversals see the same content
+      const openvdb::Index64 active_voxels = snapshot->activeVoxelCount();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      EXPECT_EQ(snapshot->activeVoxelCount(), active_voxels);
+      ++snapshots_read;
+    }
+  };
+  std::vector<std::thread> readers;
+  for (std::size_t i = 0; i < max_access_us.size(); ++i)
+  {
+    readers.emplace_back(reader, i);
+  }
+
+  // Insertion at 20 Hz
+  for (int scan = 0; scan < 20; ++scan)
+  {
+    auto next_scan = std::chrono::steady_clock::now() + std::chrono::milliseconds(50);
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 2000; ++i)
+    {
+      double angle = 0.00314 * i;
+      double range = 1.0 + 0.1 * scan;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    map.insertPointCloud(cloud, Eigen::Matrix<double, 3, 1>(0.05 * scan, 0, 0));
+    std::this_thread::sleep_until(next_scan);
+  }
+  mapping_done = true;
+  for (std::thread& thread : readers)
+  {
+    thread.join();
+  }
+  EXPECT_GT(snapshots_read, 0u);
+  for (long access_us : max_access_us)
+  {
+    EXPECT_LT(access_us, 10000);
+  }
+
+  // Without readers the latest state is published
+  map.publishSnapshot();
+  OccupancyVDBMapping::GridT::ConstPtr snapshot = map.getGridSnapshot();
+  EXPECT_EQ(snapshot->activeVoxelCount(), map.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::ConstAccessor acc = snapshot->getConstAccessor();
+  for (auto iter = map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+}
+
+TEST(Mapping, InsertPointClouds)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range           = 4;
+  conf.prob_hit            = 0.9;
+  conf.prob_miss           = 0.1;
+  conf.prob_thres_max      = 0.51;
+  conf.prob_thres_min      = 0.49;
+  conf.static_env          = false;
+  conf.parallel_raycasting = true;
+
+  // Overlapping sensors, where rays of one sensor pass through the hits of another
+  std::vector<OccupancyVDBMapping::SensorMeasurement> measurements;
+  for (int sensor = 0; sensor < 6; ++sensor)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 400; ++i)
+    {
+      double angle = 0.0157 * i;
+      double range = 1.0 + 0.3 * sensor;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    measurements.push_back({cloud, Eigen::Matrix<double, 3, 1>(0.1 * sensor, 0, 0), 0.0});
+  }
+  measurements.back().max_range = 2.0;
+
+  OccupancyVDBMapping sequential_map(resolution);
+  OccupancyVDBMapping batch_map(resolution);
+  sequential_map.setConfig(conf);
+  batch_map.setConfig(conf);
+  for (const auto& measurement : measurements)
+  {
+    sequential_map.accumulateUpdate(measurement.cloud, measurement.origin, measurement.max_range);
+  }
+  OccupancyVDBMapping::UpdateGridT::Ptr sequential_update;
+  OccupancyVDBMapping::UpdateGridT::Ptr sequential_overwrite;
+  sequential_map.integrateUpdate(sequential_update, sequential_overwrite);
+  sequential_map.resetUpdate();
+
+  OccupancyVDBMapping::UpdateGridT::Ptr batch_update;
+  OccupancyVDBMapping::UpdateGridT::Ptr batch_overwrite;
+  EXPECT_TRUE(batch_map.insertPointClouds(measurements, batch_update, batch_overwrite));
+
+  EXPECT_EQ(batch_update->activeVoxelCount(), sequential_update->activeVoxelCount());
+  OccupancyVDBMapping::UpdateGridT::Accessor update_acc = batch_update->getAccessor();
+  for (auto iter = sequential_update->cbeginValueOn(); iter; ++iter)
+  {
+    EXPECT_TRUE(update_acc.isValueOn(iter.getCoord()));
+    EXPECT_EQ(update_acc.getValue(iter.getCoord()), *iter);
+  }
+  EXPECT_EQ(batch_overwrite->activeVoxelCount(), sequential_overwrite->activeVoxelCount());
+  EXPECT_EQ(batch_map.getGrid()->activeVoxelCount(),
+            sequential_map.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = batch_map.getGrid()->getAccessor();
+  for (auto iter = sequential_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+  }
+
+  // An empty batch leaves the map unchanged
+  EXPECT_TRUE(batch_map.insertPointClouds({}));
+  EXPECT_EQ(batch_map.getGrid()->activeVoxelCount(),
+            sequential_map.getGrid()->activeVoxelCount());
+}
+
+TEST(Mapping, RecycleUpdateGrids)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+  OccupancyVDBMapping recycled_map(resolution);
+  OccupancyVDBMapping fresh_map(resolution);
+  recycled_map.setConfig(conf);
+  fresh_map.setConfig(conf);
+  conf.parallel_integration = true;
+  OccupancyVDBMapping parallel_map(resolution);
+  parallel_map.setConfig(conf);
+
+  // Recycled grids keep unused leaves, which hold no active voxels
+  auto used_leaf_count = [](const OccupancyVDBMapping::UpdateGridT& grid) {
+    std::size_t count = 0;
+    for (auto leaf_iter = grid.tree().cbeginLeaf(); leaf_iter; ++leaf_iter)
+    {
+      count += leaf_iter->isEmpty() ? 0 : 1;
+    }
+    return count;
+  };
+
+  // Holding on to all grids of the second map forces it to allocate new ones for every scan
+  std::vector<OccupancyVDBMapping::UpdateGridT::Ptr> held_grids;
+  std::set<const OccupancyVDBMapping::UpdateGridT*> update_grids;
+  std::set<const OccupancyVDBMapping::UpdateGridT*> parallel_overwrite_grids;
+  for (int scan = 0; scan < 10; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 500; ++i)
+    {
+      double angle = 0.0126 * i;
+      double range = 1.0 + 0.1 * (scan % 4);
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    Eigen::Matrix<double, 3, 1> origin(0.3 * scan, 0, 0);
+    OccupancyVDBMapping::UpdateGridT::Ptr update_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr overwrite_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr fresh_update_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr fresh_overwrite_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr parallel_update_grid;
+    OccupancyVDBMapping::UpdateGridT::Ptr parallel_overwrite_grid;
+    recycled_map.insertPointCloud(cloud, origin, update_grid, overwrite_grid);
+    fresh_map.insertPointCloud(cloud, origin, fresh_update_grid, fresh_overwrite_grid);
+    parallel_map.insertPointCloud(cloud, origin, parallel_update_grid, parallel_overwrite_grid);
+    held_grids.push_back(fresh_update_grid);
+    held_grids.push_back(fresh_overwrite_grid);
+    update_grids.insert(update_grid.get());
+    parallel_overwrite_grids.insert(parallel_overwrite_grid.get());
+
+    // Recycled grids contain no leftovers of earlier scans
+    EXPECT_EQ(update_grid->activeVoxelCount(), fresh_update_grid->activeVoxelCount());
+    EXPECT_EQ(used_leaf_count(*update_grid), fresh_update_grid->tree().leafCount());
+    EXPECT_GE(update_grid->tree().leafCount(), fresh_update_grid->tree().leafCount());
+    EXPECT_EQ(overwrite_grid->activeVoxelCount(), fresh_overwrite_grid->activeVoxelCount());
+    EXPECT_EQ(used_leaf_count(*overwrite_grid), fresh_overwrite_grid->tree().leafCount());
+    EXPECT_EQ(parallel_overwrite_grid->activeVoxelCount(),
+              fresh_overwrite_grid->activeVoxelCount());
+    EXPECT_EQ(used_leaf_count(*parallel_overwrite_grid), fresh_overwrite_grid->tree().leafCount());
+    OccupancyVDBMapping::UpdateGridT::Accessor acc = update_grid->getAccessor();
+    for (auto iter = fresh_update_grid->cbeginValueOn(); iter; ++iter)
+    {
+      EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    }
+    OccupancyVDBMapping::UpdateGridT::Accessor parallel_acc =
+      parallel_overwrite_grid->getAccessor();
+    for (auto iter = fresh_overwrite_grid->cbeginValueOn(); iter; ++iter)
+    {
+      EXPECT_TRUE(parallel_acc.isValueOn(iter.getCoord()));
+      EXPECT_EQ(parallel_acc.getValue(iter.getCoord()), *iter);
+    }
+  }
+  // Released grids are reused, so two update and change grids alternate, also when integrating in
+  // parallel
+  EXPECT_EQ(update_grids.size(), 2u);
+  EXPECT_EQ(parallel_overwrite_grids.size(), 2u);
+  EXPECT_EQ(parallel_map.getGrid()->tree().leafCount(), fresh_map.getGrid()->tree().leafCount());
+
+  EXPECT_EQ(recycled_map.getGrid()->activeVoxelCount(), fresh_map.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = recycled_map.getGrid()->getAccessor();
+  for (auto iter = fresh_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+  }
+}
+
+TEST(Mapping, IngestionPipeline)
+{
+  using PipelineT = IngestionPipeline<OccupancyVDBMapping>;
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 4;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+  std::vector<OccupancyVDBMapping::PointCloudT::Ptr> clouds;
+  for (int scan = 0; scan < 20; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 500; ++i)
+    {
+      double angle = 0.0126 * i;
+      double range = 1.0 + 0.1 * scan;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    clouds.push_back(cloud);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+
+  // Blocking backpressure processes every scan in order, yielding the same map as serial insertion
+  OccupancyVDBMapping serial_map(resolution);
+  OccupancyVDBMapping pipelined_map(resolution);
+  serial_map.setConfig(conf);
+  pipelined_map.setConfig(conf);
+  std::atomic<std::size_t> published(0);
+  PipelineT::PublishCallback count_published =
+    [&](const OccupancyVDBMapping::UpdateGridT::Ptr& update_grid,
+        const OccupancyVDBMapping::UpdateGridT::Ptr& overwrite_grid) {
+      EXPECT_TRUE(update_grid);
+      EXPECT_TRUE(overwrite_grid);
+      ++published;
+    };
+  {
+    PipelineT pipeline(pipelined_map, PipelineConfig(), count_published);
+    for (const auto& cloud : clouds)
+    {
+      serial_map.insertPointCloud(cloud, origin);
+      EXPECT_TRUE(pipeline.insertPointCloud(cloud, origin));
+    }
+    pipeline.flush();
+    PipelineStatistics stats = pipeline.statistics();
+    EXPECT_EQ(published, clouds.size());
+    EXPECT_EQ(stats.submitted, clouds.size());
+    EXPECT_EQ(stats.dropped, 0u);
+    EXPECT_EQ(stats.merged, 0u);
+    EXPECT_EQ(stats.raycast.processed, clouds.size());
+    EXPECT_EQ(stats.integrate.processed, clouds.size());
+    EXPECT_EQ(stats.publish.processed, clouds.size());
+    EXPECT_LE(stats.raycast.max_queue_depth, PipelineConfig().queue_capacity);
+    EXPECT_GE(stats.max_end_to_end_latency, stats.mean_end_to_end_latency);
+    pipeline.stop();
+    EXPECT_FALSE(pipeline.insertPointCloud(clouds.front(), origin));
+  }
+  EXPECT_EQ(pipelined_map.getGrid()->activeVoxelCount(), serial_map.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = pipelined_map.getGrid()->getAccessor();
+  for (auto iter = serial_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+  }
+
+  // A stalled publish stage fills all queues, after which the policy takes effect
+  for (BackpressurePolicy policy : {BackpressurePolicy::DROP, BackpressurePolicy::MERGE})
+  {
+    OccupancyVDBMapping map(resolution);
+    map.setConfig(conf);
+    std::atomic<bool> stalled(true);
+    published = 0;
+    PipelineConfig pipeline_conf;
+    pipeline_conf.queue_capacity = 1;
+    pipeline_conf.backpressure   = policy;
+    PipelineT pipeline(map,
+                       pipeline_conf,
+                       [&](const OccupancyVDBMapping::UpdateGridT::Ptr& update_grid,
+                           const OccupancyVDBMapping::UpdateGridT::Ptr& overwrite_grid) {
+                         while (stalled)
+                         {
+                           std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                         }
+                         count_published(update_grid, overwrite_grid);
+                       });
+    for (const auto& cloud : clouds)
+    {
+      EXPECT_TRUE(pipeline.insertPointCloud(cloud, origin));
+    }
+    stalled = false;
+    pipeline.flush();
+    PipelineStatistics stats = pipeline.statistics();
+    EXPECT_EQ(stats.submitted, clouds.size());
+    if (policy == BackpressurePolicy::DROP)
+    {
+      EXPECT_GT(stats.dropped, 0u);
+      EXPECT_EQ(published + stats.dropped, clouds.size());
+    }
+    else
+    {
+      EXPECT_GT(stats.merged, 0u);
+      EXPECT_EQ(published + stats.merged, clouds.size());
+    }
+  }
+}
+
+/*!
+ * \brief Inserts scans into a map with the given tree layout and compares it to a reference map
+ */
+template <typename TTreeLayout>
+void expectSameMapWithLayout(const OccupancyVDBMapping& reference,
+                             const double resolution,
+                             const Config& conf,
+                             const std::vector<OccupancyVDBMapping::PointCloudT::Ptr>& clouds,
+                             const Eigen::Matrix<double, 3, 1>& origin)
+{
+  OccupancyVDBMappingT<TTreeLayout> map(resolution);
+  map.setConfig(conf);
+  for (const auto& cloud : clouds)
+  {
+    EXPECT_TRUE(map.insertPointCloud(cloud, origin));
+  }
+  EXPECT_EQ(map.getGrid()->activeVoxelCount(), reference.getGrid()->activeVoxelCount());
+  EXPECT_EQ(map.getGrid()->tree().leafCount(), reference.getGrid()->tree().leafCount());
+  typename OccupancyVDBMappingT<TTreeLayout>::GridT::Accessor acc = map.getGrid()->getAccessor();
+  for (auto iter = reference.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+}
+
+TEST(Mapping, TreeLayouts)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 15;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+
+  // The scans span negative and positive coordinates beyond a single internal node
+  std::vector<OccupancyVDBMapping::PointCloudT::Ptr> clouds;
+  for (int scan = 0; scan < 3; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 400; ++i)
+    {
+      double angle = 0.0157 * i;
+      double range = 2.0 + 4.0 * scan;
+      double z     = 0.5 * (scan - 1);
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), z);
+    }
+    clouds.push_back(cloud);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+
+  OccupancyVDBMapping reference(resolution);
+  reference.setConfig(conf);
+  for (const auto& cloud : clouds)
+  {
+    reference.insertPointCloud(cloud, origin);
+  }
+  EXPECT_GT(reference.getGrid()->activeVoxelCount(), 0u);
+
+  expectSameMapWithLayout<LongRangeTreeLayout>(reference, resolution, conf, clouds, origin);
+  expectSameMapWithLayout<IndoorTreeLayout>(reference, resolution, conf, clouds, origin);
+}
+
+TEST(Mapping, UpdateGridMasks)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 10;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+
+  // A hit in either grid wins over a miss of the other one
+  OccupancyVDBMapping::UpdateGridT::Ptr source = OccupancyVDBMapping::UpdateGridT::create(false);
+  OccupancyVDBMapping::UpdateGridT::Ptr target = OccupancyVDBMapping::UpdateGridT::create(false);
+  OccupancyVDBMapping::UpdateGridT::Accessor source_acc = source->getAccessor();
+  OccupancyVDBMapping::UpdateGridT::Accessor target_acc = target->getAccessor();
+  source_acc.setValueOn(openvdb::Coord(0, 0, 0), true);
+  source_acc.setValueOn(openvdb::Coord(0, 0, 1), false);
+  source_acc.setValueOn(openvdb::Coord(0, 0, 2), false);
+  source_acc.setValueOn(openvdb::Coord(20, 0, 0), false);
+  target_acc.setValueOn(openvdb::Coord(0, 0, 0), false);
+  target_acc.setValueOn(openvdb::Coord(0, 0, 1), true);
+  target_acc.setValueOn(openvdb::Coord(0, 0, 3), true);
+  target_acc.setValueOff(openvdb::Coord(0, 0, 4), true);
+  map.mergeUpdateGrid(*source, target_acc);
+  EXPECT_EQ(target->activeVoxelCount(), 5u);
+  EXPECT_TRUE(target_acc.getValue(openvdb::Coord(0, 0, 0)));
+  EXPECT_TRUE(target_acc.getValue(openvdb::Coord(0, 0, 1)));
+  EXPECT_FALSE(target_acc.getValue(openvdb::Coord(0, 0, 2)));
+  EXPECT_TRUE(target_acc.getValue(openvdb::Coord(0, 0, 3)));
+  EXPECT_FALSE(target_acc.isValueOn(openvdb::Coord(0, 0, 4)));
+  EXPECT_FALSE(target_acc.getValue(openvdb::Coord(20, 0, 0)));
+  EXPECT_TRUE(target_acc.isValueOn(openvdb::Coord(20, 0, 0)));
+
+  // An update with an active tile is integrated voxel by voxel, one without tiles leaf by leaf
+  OccupancyVDBMapping tile_map(resolution);
+  tile_map.setConfig(conf);
+  OccupancyVDBMapping::UpdateGridT::Ptr tile_update =
+    OccupancyVDBMapping::UpdateGridT::create(false);
+  tile_update->tree().addTile(1, openvdb::Coord(0, 0, 0), false, true);
+  tile_update->tree().setValueOn(openvdb::Coord(40, 0, 0), true);
+  OccupancyVDBMapping::UpdateGridT::Ptr leaf_update = tile_update->deepCopy();
+  leaf_update->tree().voxelizeActiveTiles();
+  ASSERT_GT(tile_update->tree().activeTileCount(), 0u);
+  ASSERT_EQ(leaf_update->tree().activeTileCount(), 0u);
+
+  OccupancyVDBMapping::UpdateGridT::Ptr tile_change = tile_map.updateMap(tile_update);
+  OccupancyVDBMapping::UpdateGridT::Ptr leaf_change = map.updateMap(leaf_update);
+  EXPECT_EQ(leaf_change->activeVoxelCount(), tile_change->activeVoxelCount());
+  OccupancyVDBMapping::UpdateGridT::Accessor change_acc = leaf_change->getAccessor();
+  EXPECT_TRUE(change_acc.getValue(openvdb::Coord(40, 0, 0)));
+  for (auto iter = tile_change->cbeginValueOn(); iter; ++iter)
+  {
+    EXPECT_TRUE(change_acc.isValueOn(iter.getCoord()));
+    EXPECT_EQ(change_acc.getValue(iter.getCoord()), *iter);
+  }
+  EXPECT_EQ(map.getGrid()->activeVoxelCount(), tile_map.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = map.getGrid()->getAccessor();
+  for (auto iter = tile_map.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+  }
+}
+
+TEST(Mapping, OccupancyLeafKernels)
+{
+  using LeafT   = OccupancyUpdatePolicy::LeafT;
+  using MaskT   = OccupancyUpdatePolicy::NodeMaskType;
+  using WordT   = MaskT::Word;
+  using KernelT = OccupancyUpdatePolicy::LeafKernel;
+
+  OccupancyUpdatePolicy policy;
+  policy.logodds_hit       = static_cast<float>(log(0.7) - log(1 - 0.7));
+  policy.logodds_miss      = static_cast<float>(log(0.4) - log(1 - 0.4));
+  policy.logodds_thres_min = static_cast<float>(log(0.49) - log(1 - 0.49));
+  policy.logodds_thres_max = static_cast<float>(log(0.51) - log(1 - 0.51));
+  policy.max_logodds       = static_cast<float>(log(0.99) - log(1 - 0.99));
+  policy.min_logodds       = static_cast<float>(log(0.01) - log(1 - 0.01));
+
+  const float bounds[] = {
+    policy.min_logodds, policy.max_logodds, policy.logodds_thres_min, policy.logodds_thres_max};
+
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> choice(0, 3);
+  std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+  auto random_word = [&]() -> WordT {
+    // Empty and full words take the shortcuts of the kernels
+    switch (choice(rng))
+    {
+      case 0:
+        return 0;
+      case 1:
+        return ~WordT(0);
+      default:
+        return rng();
+    }
+  };
+
+  for (int trial = 0; trial < 100; ++trial)
+  {
+    // Values hit the clamping and threshold bounds exactly after an update or lie close to them
+    LeafT leaf(openvdb::Coord(0, 0, 0), 0.0f);
+    for (openvdb::Index i = 0; i < LeafT::SIZE; ++i)
+    {
+      const float bound = bounds[choice(rng)];
+      switch (choice(rng))
+      {
+        case 0:
+          leaf.buffer().data()[i] = bound;
+          break;
+        case 1:
+          leaf.buffer().data()[i] = bound - policy.logodds_hit;
+          break;
+        case 2:
+          leaf.buffer().data()[i] = bound - policy.logodds_miss;
+          break;
+        default:
+          leaf.buffer().data()[i] = bound + offset(rng);
+      }
+    }
+    MaskT update_mask;
+    MaskT hit_mask;
+    MaskT active_mask;
+    for (openvdb::Index n = 0; n < MaskT::WORD_COUNT; ++n)
+    {
+      update_mask.getWord<WordT>(n) = random_word();
+      hit_mask.getWord<WordT>(n)    = random_word();
+      active_mask.getWord<WordT>(n) = random_word();
+    }
+    leaf.setValueMask(active_mask);
+
+    // Reference result of the per voxel update rules
+    LeafT expected(leaf);
+    for (auto iter = update_mask.beginOn(); iter; ++iter)
+    {
+      float value = expected.getValue(iter.pos());
+      bool active = expected.isValueOn(iter.pos());
+      if (hit_mask.isOn(iter.pos()))
+      {
+        policy.updateOccupiedNode(value, active);
+      }
+      else
+      {
+        policy.updateFreeNode(value, active);
+      }
+      expected.setValueOnly(iter.pos(), value);
+      expected.setActiveState(iter.pos(), active);
+    }
+
+    for (const KernelT kernel : {KernelT::SCALAR, KernelT::AVX2})
+    {
+      if (!OccupancyUpdatePolicy::leafKernelSupported(kernel))
+      {
+        continue;
+      }
+      policy.leaf_kernel = kernel;
+      LeafT updated(leaf);
+      MaskT change_mask;
+      policy.updateLeaf(update_mask, hit_mask, updated, change_mask);
+      for (openvdb::Index i = 0; i < LeafT::SIZE; ++i)
+      {
+        EXPECT_EQ(updated.getValue(i), expected.getValue(i));
+      }
+      EXPECT_EQ(updated.getValueMask(), expected.getValueMask());
+      EXPECT_EQ(change_mask, leaf.getValueMask() ^ expected.getValueMask());
+    }
+  }
+}
+
+TEST(Mapping, BoundingBoxes)
+{
+  OccupancyVDBMapping map(0.1);
+  Eigen::Matrix<double, 3, 1> min_boundary(-2.3, -1.7, -0.5);
+  Eigen::Matrix<double, 3, 1> max_boundary(4.1, 1.9, 2.2);
+
+  OccupancyVDBMapping::TransformVectorT tfs;
+  for (int i = 0; i < 16; ++i)
+  {
+    Eigen::Affine3d tf(Eigen::AngleAxisd(0.4 * i, Eigen::Vector3d(1, 2, 3).normalized()));
+    tf.translation() = Eigen::Vector3d(0.7 * i, -0.3 * i, 0.05 * i);
+    tfs.push_back(tf.matrix());
+  }
+
+  std::vector<openvdb::CoordBBox> index_bbs;
+  map.createIndexBoundingBoxes(min_boundary, max_boundary, tfs, index_bbs);
+  ASSERT_EQ(index_bbs.size(), tfs.size());
+  for (std::size_t i = 0; i < tfs.size(); ++i)
+  {
+    // Reference result of transforming the corners as a point cloud
+    OccupancyVDBMapping::PointCloudT corners;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      corners.points.emplace_back((corner & 4) ? max_boundary.x() : min_boundary.x(),
+                                  (corner & 2) ? max_boundary.y() : min_boundary.y(),
+                                  (corner & 1) ? max_boundary.z() : min_boundary.z());
+    }
+    pcl::transformPointCloud(corners, corners, tfs[i]);
+    pcl::PointXYZ min_pt;
+    pcl::PointXYZ max_pt;
+    pcl::getMinMax3D(corners, min_pt, max_pt);
+
+    openvdb::BBoxd world_bb = map.createWorldBoundingBox(min_boundary, max_boundary, tfs[i]);
+    EXPECT_NEAR(world_bb.min().x(), min_pt.x, 1e-5);
+    EXPECT_NEAR(world_bb.min().y(), min_pt.y, 1e-5);
+    EXPECT_NEAR(world_bb.min().z(), min_pt.z, 1e-5);
+    EXPECT_NEAR(world_bb.max().x(), max_pt.x, 1e-5);
+    EXPECT_NEAR(world_bb.max().y(), max_pt.y, 1e-5);
+    EXPECT_NEAR(world_bb.max().z(), max_pt.z, 1e-5);
+    EXPECT_EQ(index_bbs[i], map.createIndexBoundingBox(min_boundary, max_boundary, tfs[i]));
+  }
+}
+
+TEST(Mapping, PointSpans)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range             = 5;
+  conf.prob_hit              = 0.9;
+  conf.prob_miss             = 0.1;
+  conf.prob_thres_max        = 0.51;
+  conf.prob_thres_min        = 0.49;
+  conf.deduplicate_endpoints = true;
+
+  // The same scan as xyz cloud, as intensity cloud and as raw driver buffer with five floats per
+  // point
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  pcl::PointCloud<pcl::PointXYZI> intensity_cloud;
+  std::vector<float> buffer;
+  for (int i = 0; i < 300; ++i)
+  {
+    double angle = 0.021 * i;
+    double range = 1.0 + 0.02 * i;
+    pcl::PointXYZI point;
+    point.x         = static_cast<float>(range * std::cos(angle));
+    point.y         = static_cast<float>(range * std::sin(angle));
+    point.z         = static_cast<float>(0.1 * (i % 7));
+    point.intensity = static_cast<float>(i);
+    cloud->points.emplace_back(point.x, point.y, point.z);
+    intensity_cloud.points.push_back(point);
+    buffer.insert(buffer.end(), {point.x, point.y, point.z, point.intensity, 0.0f});
+  }
+  Eigen::Matrix<double, 3, 1> origin(0.2, -0.1, 0.3);
+
+  OccupancyVDBMapping reference(resolution);
+  OccupancyVDBMapping intensity_map(resolution);
+  OccupancyVDBMapping buffer_map(resolution);
+  reference.setConfig(conf);
+  intensity_map.setConfig(conf);
+  buffer_map.setConfig(conf);
+  EXPECT_TRUE(reference.insertPointCloud(cloud, origin));
+  EXPECT_TRUE(intensity_map.insertPointCloud(intensity_cloud, origin));
+  EXPECT_TRUE(buffer_map.insertPointCloud(
+    PointSpan(buffer.data(), buffer.size() / 5, 5 * sizeof(float)), origin));
+
+  for (const OccupancyVDBMapping* map : {&intensity_map, &buffer_map})
+  {
+    EXPECT_EQ(map->getGrid()->activeVoxelCount(), reference.getGrid()->activeVoxelCount());
+    OccupancyVDBMapping::GridT::Accessor acc = map->getGrid()->getAccessor();
+    for (auto iter = reference.getGrid()->cbeginValueAll(); iter; ++iter)
+    {
+      EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    }
+  }
+}
+
+TEST(Mapping, SensorFramePoints)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 5;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+
+  // Quarter turn around z, so that the transformed coordinates stay exactly representable and the
+  // fused transform matches the transformed cloud bit by bit
+  Eigen::Isometry3d sensor_to_map_tf = Eigen::Isometry3d::Identity();
+  sensor_to_map_tf.linear() << 0, -1, 0, 1, 0, 0, 0, 0, 1;
+  sensor_to_map_tf.translation() << 0.5, 1.25, 0.25;
+
+  OccupancyVDBMapping::PointCloudT::Ptr sensor_cloud(new OccupancyVDBMapping::PointCloudT);
+  OccupancyVDBMapping::PointCloudT::Ptr map_cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 300; ++i)
+  {
+    double angle = 0.021 * i;
+    double range = 1.0 + 0.02 * i;
+    float x      = static_cast<float>(std::round(range * std::cos(angle) * 256.0) / 256.0);
+    float y      = static_cast<float>(std::round(range * std::sin(angle) * 256.0) / 256.0);
+    float z      = static_cast<float>((i % 7) / 8.0);
+    sensor_cloud->points.emplace_back(x, y, z);
+    Eigen::Vector3d map_point = sensor_to_map_tf * Eigen::Vector3d(x, y, z);
+    map_cloud->points.emplace_back(static_cast<float>(map_point.x()),
+                                   static_cast<float>(map_point.y()),
+                                   static_cast<float>(map_point.z()));
+  }
+
+  OccupancyVDBMapping reference(resolution);
+  OccupancyVDBMapping isometry_map(resolution);
+  OccupancyVDBMapping matrix_map(resolution);
+  reference.setConfig(conf);
+  isometry_map.setConfig(conf);
+  matrix_map.setConfig(conf);
+  EXPECT_TRUE(reference.insertPointCloud(map_cloud, sensor_to_map_tf.translation()));
+  EXPECT_TRUE(isometry_map.insertPointCloud(*sensor_cloud, sensor_to_map_tf));
+  EXPECT_TRUE(matrix_map.insertPointCloud(*sensor_cloud, sensor_to_map_tf.matrix()));
+
+  for (const OccupancyVDBMapping* map : {&isometry_map, &matrix_map})
+  {
+    EXPECT_EQ(map->getGrid()->activeVoxelCount(), reference.getGrid()->activeVoxelCount());
+    OccupancyVDBMapping::GridT::Accessor acc = map->getGrid()->getAccessor();
+    for (auto iter = reference.getGrid()->cbeginValueAll(); iter; ++iter)
+    {
+      EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    }
+  }
+
+  // Composing a span transform with a pose equals applying the combined pose
+  Eigen::Isometry3d offset_tf = Eigen::Isometry3d::Identity();
+  offset_tf.translation() << 0.0, 0.0, 1.0;
+  PointSpan composed =
+    PointSpan(*sensor_cloud).transformed(offset_tf).transformed(sensor_to_map_tf);
+  for (std::size_t i = 0; i < composed.size(); i += 50)
+  {
+    Eigen::Vector3d expected =
+      sensor_to_map_tf * (offset_tf * sensor_cloud->points[i].getVector3fMap().cast<double>());
+    EXPECT_EQ(composed[i], openvdb::Vec3d(expected.x(), expected.y(), expected.z()));
+  }
+}
+
+template <typename TMapping>
+void expectQuantizedMap(const OccupancyVDBMapping& reference,
+                        const double resolution,
+                        const Config& conf,
+                        const std::vector<OccupancyVDBMapping::PointCloudT::Ptr>& clouds,
+                        const Eigen::Matrix<double, 3, 1>& origin,
+                        const float tolerance)
+{
+  TMapping map(resolution);
+  map.setConfig(conf);
+  for (const auto& cloud : clouds)
+  {
+    EXPECT_TRUE(map.insertPointCloud(cloud, origin));
+  }
+
+  EXPECT_EQ(map.getGrid()->activeVoxelCount(), reference.getGrid()->activeVoxelCount());
+  EXPECT_EQ(map.getGrid()->tree().leafCount(), reference.getGrid()->tree().leafCount());
+  typename TMapping::GridT::Accessor acc = map.getGrid()->getAccessor();
+  for (auto iter = reference.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+    EXPECT_NEAR(map.logOdds(acc.getValue(iter.getCoord())), *iter, tolerance);
+  }
+}
+
+TEST(Mapping, QuantizedOccupancy)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 15;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+
+  // Rays of the outer scans pass the hits of the inner ones, so voxels see hits and misses
+  std::vector<OccupancyVDBMapping::PointCloudT::Ptr> clouds;
+  for (int scan = 0; scan < 3; ++scan)
+  {
+    OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+    for (int i = 0; i < 400; ++i)
+    {
+      double angle = 0.0157 * i;
+      double range = 2.0 + 1.5 * scan;
+      cloud->points.emplace_back(range * std::cos(angle), range * std::sin(angle), 0.0);
+    }
+    clouds.push_back(cloud);
+  }
+  clouds.push_back(clouds.front());
+  Eigen::Matrix<double, 3, 1> origin(0, 0, 0);
+
+  OccupancyVDBMapping reference(resolution);
+  reference.setConfig(conf);
+  for (const auto& cloud : clouds)
+  {
+    reference.insertPointCloud(cloud, origin);
+  }
+  EXPECT_GT(reference.getGrid()->activeVoxelCount(), 0u);
+
+  // The rounding error of each update is at most half a quantization step
+  expectQuantizedMap<Int8OccupancyVDBMapping>(reference, resolution, conf, clouds, origin, 0.1f);
+  expectQuantizedMap<Int16OccupancyVDBMapping>(reference, resolution, conf, clouds, origin, 1e-3f);
+
+  // Saturation at the clamping range
+  Int8OccupancyVDBMapping map(resolution);
+  map.setConfig(conf);
+  EXPECT_EQ(map.quantize(100.0), 127);
+  EXPECT_EQ(map.quantize(-100.0), -127);
+  EXPECT_NEAR(map.logOdds(127), std::log(0.99) - std::log(0.01), 1e-5);
+  for (int i = 0; i < 4; ++i)
+  {
+    map.insertPointCloud(clouds.front(), origin);
+  }
+  int max_value = 0;
+  for (auto iter = map.getGrid()->cbeginValueOn(); iter; ++iter)
+  {
+    max_value = std::max<int>(max_value, *iter);
+  }
+  EXPECT_EQ(max_value, 127);
+}
+
+TEST(Mapping, PruneMap)
+{
+  double resolution = 0.1;
+  Config conf;
+  conf.max_range      = 5;
+  conf.prob_hit       = 0.9;
+  conf.prob_miss      = 0.1;
+  conf.prob_thres_max = 0.51;
+  conf.prob_thres_min = 0.49;
+  conf.static_env     = false;
+
+  // 64 leaves of saturated free space, a saturated occupied leaf and one leaf with a single
+  // differing voxel
+  const float min_logodds = static_cast<float>(std::log(0.01) - std::log(0.99));
+  const float max_logodds = static_cast<float>(std::log(0.99) - std::log(0.01));
+  OccupancyVDBMapping reference(resolution);
+  OccupancyVDBMapping map(resolution);
+  reference.setConfig(conf);
+  map.setConfig(conf);
+  for (OccupancyVDBMapping* mapping : {&reference, &map})
+  {
+    OccupancyVDBMapping::GridT::TreeType& tree = mapping->getGrid()->tree();
+    tree.denseFill(openvdb::CoordBBox(openvdb::Coord(0), openvdb::Coord(31)), min_logodds, false);
+    tree.denseFill(
+      openvdb::CoordBBox(openvdb::Coord(32, 0, 0), openvdb::Coord(39, 7, 7)), max_logodds, true);
+    tree.denseFill(
+      openvdb::CoordBBox(openvdb::Coord(40, 0, 0), openvdb::Coord(47, 7, 7)), min_logodds, false);
+    tree.setValueOn(openvdb::Coord(41, 1, 1), max_logodds);
+  }
+  EXPECT_EQ(map.getGrid()->tree().leafCount(), 66u);
+
+  // A zero budget still makes progress by one leaf per call
+  PruneStatistics statistics = map.pruneMap(std::chrono::microseconds(0));
+  EXPECT_EQ(statistics.visited_leaves, 1u);
+  EXPECT_FALSE(statistics.complete);
+  std::size_t collapsed_leaves = statistics.collapsed_leaves;
+  std::size_t reclaimed_bytes  = statistics.reclaimed_bytes;
+  while (!statistics.complete)
+  {
+    statistics = map.pruneMap(std::chrono::microseconds(100));
+    collapsed_leaves += statistics.collapsed_leaves;
+    reclaimed_bytes += statistics.reclaimed_bytes;
+  }
+  EXPECT_EQ(collapsed_leaves, 65u);
+  EXPECT_GE(reclaimed_bytes, 65 * 512 * sizeof(float));
+  EXPECT_EQ(map.getGrid()->tree().leafCount(), 1u);
+  EXPECT_LT(map.getGrid()->memUsage(), reference.getGrid()->memUsage());
+
+  // Queries and later updates behave as without pruning
+  OccupancyVDBMapping::PointCloudT::Ptr cloud(new OccupancyVDBMapping::PointCloudT);
+  for (int i = 0; i < 200; ++i)
+  {
+    double angle = 0.0078 * i;
+    cloud->points.emplace_back(3.0 * std::cos(angle), 3.0 * std::sin(angle), 0.35);
+  }
+  Eigen::Matrix<double, 3, 1> origin(0.05, 0.05, 0.35);
+  reference.insertPointCloud(cloud, origin);
+  map.insertPointCloud(cloud, origin);
+
+  EXPECT_EQ(map.getGrid()->activeVoxelCount(), reference.getGrid()->activeVoxelCount());
+  OccupancyVDBMapping::GridT::Accessor acc = map.getGrid()->getAccessor();
+  for (auto iter = reference.getGrid()->cbeginValueAll(); iter; ++iter)
+  {
+    EXPECT_EQ(acc.getValue(iter.getCoord()), *iter);
+    EXPECT_EQ(acc.isValueOn(iter.getCoord()), iter.isValueOn());
+  }
+}
+
 } // namespace vdb_mapping
 
 int main(int argc, char** argv)